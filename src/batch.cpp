@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <glob.h>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <omp.h>
+#include <optional>
+#include <print>
+
+#include "batch.h"
+#include "candidates.h"
+#include "config.h"
+#include "executor.h"
+#include "method.h"
+#include "options.h"
+#include "parameters.h"
+#include "formats/reader.h"
+#include "formats/save_charges.h"
+#include "utility/compression.h"
+#include "utility/exceptions.h"
+#include "utility/install.h"
+#include "utility/strings.h"
+
+
+namespace fs = std::filesystem;
+
+
+/* One method instance per parameter set; methods keep their parameters, so files using different sets cannot share
+ * an instance while running concurrently */
+using MethodInstances = std::map<const Parameters *, std::unique_ptr<Method>>;
+
+
+static std::vector<std::string> expand_input(const std::string &input) {
+    std::vector<std::string> files;
+    if (fs::is_directory(input)) {
+        for (const auto &entry: fs::directory_iterator(input)) {
+            if (entry.is_regular_file() and is_supported_input_file(entry.path().string())) {
+                files.emplace_back(entry.path().string());
+            }
+        }
+        std::ranges::sort(files);
+    } else if (input.find_first_of("*?[") != std::string::npos) {
+        glob_t matches{};
+        int status = glob(input.c_str(), 0, nullptr, &matches);
+        if (status == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                files.emplace_back(matches.gl_pathv[i]);
+            }
+        }
+        globfree(&matches);
+        if (status != 0 and status != GLOB_NOMATCH) {
+            throw FileException(std::format("Cannot expand pattern {}", input));
+        }
+    } else {
+        files.push_back(input);
+    }
+    return files;
+}
+
+
+std::vector<std::string> collect_batch_inputs(const std::string &input, const std::string &input_list) {
+    std::vector<std::string> files;
+    if (not input_list.empty()) {
+        std::ifstream list(input_list);
+        if (!list) {
+            throw FileException(std::format("Cannot open file: {}", input_list));
+        }
+
+        std::string line;
+        while (std::getline(list, line)) {
+            auto file = trim(line);
+            if (not file.empty()) {
+                files.push_back(std::move(file));
+            }
+        }
+    }
+
+    if (not input.empty()) {
+        auto expanded = expand_input(input);
+        files.insert(files.end(), expanded.begin(), expanded.end());
+    }
+
+    return files;
+}
+
+
+static size_t process_file(const std::string &file, const std::vector<std::unique_ptr<Parameters>> &parameters,
+                           const MethodInstances &methods) {
+    auto ms = load_molecule_set(file);
+    if (ms.molecules().empty()) {
+        throw FileException("No molecules were loaded from the input file");
+    }
+
+    Parameters *p = nullptr;
+    if (not parameters.empty()) {
+        if (config::par_file.empty()) {
+            p = best_parameters(ms, parameters, ms.has_proteins(), config::permissive_types);
+            if (p == nullptr) {
+                throw ParameterException("No parameters found");
+            }
+        } else {
+            p = parameters.front().get();
+        }
+        ms.classify_set_from_parameters(*p, true, config::permissive_types);
+    } else {
+        ms.classify_atoms(AtomClassifier::PLAIN);
+    }
+
+    const auto &method = *methods.at(p);
+    ms.fulfill_requirements(method.get_requirements());
+
+    ChargesOutput output(ms, method.metadata().name, p != nullptr ? p->name() : "None", file);
+
+    calculate_all_charges(method, ms, [&ms, &output](size_t i, std::vector<double> results) {
+        if (std::ranges::any_of(results, [](double chg) noexcept { return not std::isfinite(chg); })) {
+            std::println(stderr, "Cannot compute charges for {}: Method returned numerically incorrect values",
+                         ms.molecules()[i].name());
+            output.skip(i);
+            return;
+        }
+        output.submit(i, std::move(results));
+    });
+
+    output.finish();
+    std::println("{}: {} molecules, parameters: {}", file, ms.molecules().size(), p != nullptr ? p->name() : "None");
+
+    return ms.molecules().size();
+}
+
+
+/* Number of molecules processed, or nothing if the file failed (the reason is printed) */
+static std::optional<size_t> process_or_report(const std::string &file,
+                                               const std::vector<std::unique_ptr<Parameters>> &parameters,
+                                               const MethodInstances &methods) {
+    try {
+        return process_file(file, parameters, methods);
+    } catch (std::exception &e) {
+        std::println(stderr, "{}: {}", file, e.what());
+        return std::nullopt;
+    }
+}
+
+
+/* The output files are named after the input files, so two inputs with the same name would overwrite each other */
+static void check_output_names(const std::vector<std::string> &files) {
+    std::map<std::string, const std::string *> names;
+    for (const auto &file: files) {
+        auto name = fs::path(strip_compression_extension(file)).filename().string();
+        if (auto [it, inserted] = names.try_emplace(std::move(name), &file); not inserted) {
+            throw ParameterException(std::format("Input files {} and {} would be written to the same output files",
+                                                 *it->second, file));
+        }
+    }
+}
+
+
+BatchSummary run_batch(const std::vector<std::string> &files, const std::string &method_name,
+                       const boost::program_options::parsed_options &parsed) {
+    check_output_names(files);
+
+    auto method = load_method(method_name);
+    setup_method_options(*method, parsed);
+
+    BatchSummary summary{.method_name = method->metadata().name, .files = files.size()};
+
+    std::vector<std::unique_ptr<Parameters>> parameters;
+    MethodInstances methods;
+    if (method->has_parameters()) {
+        try {
+            if (config::par_file.empty()) {
+                parameters = load_method_parameters(method_name);
+            } else {
+                parameters.emplace_back(
+                        std::make_unique<Parameters>(InstallPaths::parametersdir() / (config::par_file + ".json")));
+            }
+
+            for (const auto &p: parameters) {
+                auto instance = load_method(method_name);
+                setup_method_options(*instance, parsed);
+                instance->set_parameters(p.get());
+                methods.emplace(p.get(), std::move(instance));
+            }
+        } catch (std::runtime_error &e) {
+            throw FileException(e.what());
+        }
+
+        if (parameters.empty()) {
+            throw ParameterException("No parameters found");
+        }
+    } else {
+        methods.emplace(nullptr, std::move(method));
+    }
+
+    /* Files are scheduled the same way as molecules in calculate_all_charges, using their size as the estimate of work:
+     * a file with a substantial part of all data gets every thread, the others are processed one file per thread */
+    const size_t n = files.size();
+    std::vector<uintmax_t> sizes(n);
+    for (size_t i = 0; i < n; i++) {
+        std::error_code ec;
+        auto size = fs::file_size(files[i], ec);
+        sizes[i] = ec ? 0 : size;
+    }
+
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    const uintmax_t total_size = std::accumulate(sizes.begin(), sizes.end(), uintmax_t{0});
+    const auto threads = static_cast<uintmax_t>(omp_get_max_threads());
+
+    size_t failed = 0;
+    size_t molecules = 0;
+
+    size_t first_small = 0;
+    while (first_small < n and sizes[order[first_small]] * threads >= total_size) {
+        if (auto count = process_or_report(files[order[first_small]], parameters, methods)) {
+            molecules += *count;
+        } else {
+            failed++;
+        }
+        first_small++;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) default(none) shared(files, order, parameters, methods) firstprivate(n, first_small) reduction(+:failed, molecules)
+    for (size_t i = first_small; i < n; i++) {
+        if (auto count = process_or_report(files[order[i]], parameters, methods)) {
+            molecules += *count;
+        } else {
+            failed++;
+        }
+    }
+
+    summary.failed = failed;
+    summary.molecules = molecules;
+    return summary;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+
+struct BatchSummary {
+    std::string method_name;
+    size_t files{0};
+    size_t failed{0};
+    size_t molecules{0};
+};
+
+/* Input files given by a list file (one path per line) and by a directory (its readable files), a glob pattern or
+ * a single file name */
+std::vector<std::string> collect_batch_inputs(const std::string &input, const std::string &input_list);
+
+/* Calculate and write charges of every file. The method and its parameter sets are loaded only once and the files
+ * are processed concurrently; a file which cannot be processed is reported and skipped. Files with the same name
+ * (which would share the output files) are rejected before anything is computed */
+BatchSummary run_batch(const std::vector<std::string> &files, const std::string &method_name,
+                       const boost::program_options::parsed_options &parsed);
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iterator>
 #include <memory>
 #include <nlohmann/json.hpp>
@@ -34,22 +35,28 @@ std::vector<fs::path> get_parameter_files() {
 }
 
 
-std::vector<std::unique_ptr<Parameters>>
-get_valid_parameters(MoleculeSet &ms, bool is_protein, bool permissive_types, const std::string &method_name) {
-    std::vector<std::unique_ptr<Parameters>> protein_parameters;
-    std::vector<std::unique_ptr<Parameters>> ligand_parameters;
-
+std::vector<std::unique_ptr<Parameters>> load_method_parameters(const std::string &method_name) {
+    std::vector<std::unique_ptr<Parameters>> parameters;
     for (const auto &parameter_file: get_parameter_files()) {
         if (not to_lowercase(parameter_file.filename().string()).starts_with(method_name)) {
             continue;
         }
 
         auto p = std::make_unique<Parameters>(parameter_file);
-
-        if (method_name != p->method_name()) {
-            continue;
+        if (method_name == p->method_name()) {
+            parameters.emplace_back(std::move(p));
         }
+    }
+    return parameters;
+}
+
+
+std::vector<std::unique_ptr<Parameters>>
+get_valid_parameters(MoleculeSet &ms, bool is_protein, bool permissive_types, const std::string &method_name) {
+    std::vector<std::unique_ptr<Parameters>> protein_parameters;
+    std::vector<std::unique_ptr<Parameters>> ligand_parameters;
 
+    for (auto &p: load_method_parameters(method_name)) {
         size_t unclassified = ms.classify_set_from_parameters(*p, false, permissive_types);
 
         if (!unclassified) {
@@ -130,3 +137,20 @@ best_parameters(MoleculeSet &ms, const Method&method, bool is_protein, bool perm
 
     return std::move(parameters.front());
 }
+
+
+Parameters *best_parameters(MoleculeSet &ms, const std::vector<std::unique_ptr<Parameters>> &candidates, bool is_protein,
+                            bool permissive_types) {
+    /* Same preference as above, but the search stops at the first parameter set covering the whole set */
+    for (bool protein_source: {is_protein, not is_protein}) {
+        for (const auto &p: candidates) {
+            if ((p->source() == "protein") != protein_source) {
+                continue;
+            }
+            if (not ms.classify_set_from_parameters(*p, false, permissive_types)) {
+                return p.get();
+            }
+        }
+    }
+    return nullptr;
+}
@@ -14,3 +14,10 @@ get_suitable_methods(MoleculeSet& ms, const std::vector<std::unique_ptr<Method>>
 
 std::optional<std::unique_ptr<Parameters>>
 best_parameters(MoleculeSet& ms, const Method& method, bool is_protein, bool permissive_types = false);
+
+/* Parameter sets of the method in the order of their priority */
+std::vector<std::unique_ptr<Parameters>> load_method_parameters(const std::string &method_name);
+
+/* Variant for repeated selection among already loaded parameter sets; nullptr if none of them fits */
+Parameters *best_parameters(MoleculeSet &ms, const std::vector<std::unique_ptr<Parameters>> &candidates, bool is_protein,
+                            bool permissive_types = false);
@@ -24,5 +24,7 @@ public:
 
     std::vector<double> operator[](const std::string& name) const { return charges_.at(name); }
 
+    [[nodiscard]] const std::vector<double> &values(const std::string& name) const { return charges_.at(name); }
+
     void insert(const std::string& name, std::vector<double> charges);
 };
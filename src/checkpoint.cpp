@@ -0,0 +1,218 @@
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <print>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "chargefw2.h"
+#include "checkpoint.h"
+#include "config.h"
+#include "ee_method.h"
+#include "utility/exceptions.h"
+#include "utility/hasher.h"
+#include "utility/mapped_file.h"
+
+
+/*
+ * File layout (native endianness, append-only):
+ *   Header
+ *   char context[context_size]
+ *   Record[]: uint64_t index, uint64_t n_charges, uint64_t checksum, double charges[n_charges]
+ * The context describes the computation, a checkpoint is resumed only by the same one. A record cut short by the
+ * interruption (or not matching its checksum, e.g. a zero-filled tail after a power loss) is discarded together with
+ * everything after it.
+ */
+
+namespace {
+    constexpr char MAGIC[8] = {'F', 'W', '2', 'C', 'H', 'K', '\0', '\0'};
+    constexpr uint32_t FORMAT_VERSION = 2;
+    constexpr uint32_t ENDIANNESS_CHECK = 0x01020304;
+
+    /* Finished molecules are synced to the disk at most this often... */
+    constexpr auto SYNC_INTERVAL = std::chrono::seconds(10);
+    /* ...unless they take more memory than this */
+    constexpr size_t SYNC_THRESHOLD = 16 << 20;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t endianness;
+        uint64_t context_size;
+    };
+
+    struct RecordHeader {
+        uint64_t index;
+        uint64_t n_charges;
+        uint64_t checksum;
+    };
+
+    uint64_t checksum(const RecordHeader &record, const char *charges) {
+        Hasher hasher;
+        hasher.add(record.index);
+        hasher.add(record.n_charges);
+        hasher.add_raw(charges, record.n_charges);
+        return hasher.digest()[0];
+    }
+
+    std::string describe(const Method &method, const Parameters *parameters, size_t molecules) {
+        auto context = std::format("{};{};{};{};{}", VERSION, method.metadata().internal_name,
+                                   parameters != nullptr ? parameters->metadata().internal_name : "None",
+                                   molecules, config::permissive_types);
+        for (const auto &[name, option]: method.get_options()) {
+            context += std::format(";{}={}", name, method.get_option_value<std::string>(name));
+        }
+        if (parameters != nullptr) {
+            const auto digest = parameters->digest();
+            context += std::format(";{:016x}{:016x}", digest[0], digest[1]);
+        }
+        if (const auto *ee_method = dynamic_cast<const EEMethod *>(&method); ee_method != nullptr) {
+            context += ";" + solver_settings(*ee_method);
+        }
+
+        /* The records refer to the molecules by their index, so the input file must not change in between */
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        context += std::format(";{};{};{}", fs::canonical(config::input_file, ec).string(),
+                               fs::file_size(config::input_file, ec),
+                               fs::last_write_time(config::input_file, ec).time_since_epoch().count());
+        return context;
+    }
+
+    void write_all(int fd, const char *data, size_t size, const std::string &filename) {
+        while (size != 0) {
+            auto n = write(fd, data, size);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw FileException(std::format("Cannot write checkpoint {}: {}", filename, std::strerror(errno)));
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+}
+
+
+Checkpoint::Checkpoint(std::string filename, const Method &method, const Parameters *parameters, size_t molecules,
+                       bool resume) : filename_{std::move(filename)}, last_sync_{std::chrono::steady_clock::now()} {
+    const auto context = describe(method, parameters, molecules);
+
+    std::error_code ec;
+    if (resume and std::filesystem::exists(filename_, ec)) {
+        MappedFile mapped(filename_);
+        const auto data = mapped.view();
+
+        Header header{};
+        if (data.size() < sizeof(header)) {
+            throw FileException(std::format("File {} is not a checkpoint", filename_));
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 or header.version != FORMAT_VERSION or
+            header.endianness != ENDIANNESS_CHECK) {
+            throw FileException(std::format("File {} is not a checkpoint of this version", filename_));
+        }
+        if (header.context_size != context.size() or data.size() - sizeof(header) < context.size() or
+            data.substr(sizeof(header), context.size()) != context) {
+            throw FileException(std::format("Checkpoint {} belongs to a different computation", filename_));
+        }
+
+        size_t offset = sizeof(header) + context.size();
+        while (offset + sizeof(RecordHeader) <= data.size()) {
+            RecordHeader record{};
+            std::memcpy(&record, data.data() + offset, sizeof(record));
+            const size_t begin = offset + sizeof(record);
+            if (record.index >= molecules or record.n_charges > (data.size() - begin) / sizeof(double) or
+                record.checksum != checksum(record, data.data() + begin)) {
+                break;
+            }
+            std::vector<double> charges(record.n_charges);
+            std::memcpy(charges.data(), data.data() + begin, record.n_charges * sizeof(double));
+            completed_.insert_or_assign(record.index, std::move(charges));
+            offset = begin + record.n_charges * sizeof(double);
+        }
+
+        fd_ = open(filename_.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd_ == -1) {
+            throw FileException(std::format("Cannot open checkpoint: {}", filename_));
+        }
+
+        /* A damaged record is dropped, new ones follow the last complete one */
+        if ((offset != data.size() and ftruncate(fd_, static_cast<off_t>(offset)) == -1) or
+            lseek(fd_, static_cast<off_t>(offset), SEEK_SET) == -1) {
+            close(fd_);
+            throw FileException(std::format("Cannot repair checkpoint: {}", filename_));
+        }
+        return;
+    }
+
+    fd_ = open(filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ == -1) {
+        throw FileException(std::format("Cannot create checkpoint: {}", filename_));
+    }
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.endianness = ENDIANNESS_CHECK;
+    header.context_size = context.size();
+    try {
+        write_all(fd_, reinterpret_cast<const char *>(&header), sizeof(header), filename_);
+        write_all(fd_, context.data(), context.size(), filename_);
+        fdatasync(fd_);
+    } catch (FileException &) {
+        close(fd_);
+        throw;
+    }
+}
+
+
+Checkpoint::~Checkpoint() {
+    if (fd_ == -1) {
+        return;
+    }
+
+    try {
+        sync();
+    } catch (FileException &e) {
+        std::println(stderr, "{}", e.what());
+    }
+    close(fd_);
+}
+
+
+void Checkpoint::record(size_t index, const std::vector<double> &charges) {
+    RecordHeader record{index, charges.size(), 0};
+    record.checksum = checksum(record, reinterpret_cast<const char *>(charges.data()));
+
+    std::lock_guard lock(mutex_);
+    const auto *begin = reinterpret_cast<const char *>(&record);
+    pending_.insert(pending_.end(), begin, begin + sizeof(record));
+    const auto *values = reinterpret_cast<const char *>(charges.data());
+    pending_.insert(pending_.end(), values, values + charges.size() * sizeof(double));
+
+    if (pending_.size() >= SYNC_THRESHOLD or std::chrono::steady_clock::now() - last_sync_ >= SYNC_INTERVAL) {
+        sync();
+    }
+}
+
+
+void Checkpoint::sync() {
+    if (not pending_.empty()) {
+        write_all(fd_, pending_.data(), pending_.size(), filename_);
+        pending_.clear();
+        fdatasync(fd_);
+    }
+    last_sync_ = std::chrono::steady_clock::now();
+}
+
+
+void Checkpoint::remove() {
+    std::lock_guard lock(mutex_);
+    pending_.clear();
+    close(fd_);
+    fd_ = -1;
+    std::filesystem::remove(filename_);
+}
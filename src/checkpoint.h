@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "method.h"
+#include "parameters.h"
+
+
+/* Progress of a computation over one molecule set, see checkpoint.cpp for the layout. Results are appended as the
+ * molecules are finished and synced to the disk in batches, so a run that was interrupted can be resumed with only
+ * the molecules that were not finished yet */
+class Checkpoint {
+    std::string filename_;
+    int fd_{-1};
+    std::map<size_t, std::vector<double>> completed_{};
+
+    std::mutex mutex_{};
+    std::vector<char> pending_{};
+    std::chrono::steady_clock::time_point last_sync_{};
+
+    void sync();
+
+public:
+    /* An existing checkpoint of the same computation is loaded if resuming, otherwise a new one is started */
+    Checkpoint(std::string filename, const Method &method, const Parameters *parameters, size_t molecules,
+               bool resume);
+
+    Checkpoint(const Checkpoint &) = delete;
+
+    Checkpoint &operator=(const Checkpoint &) = delete;
+
+    ~Checkpoint();
+
+    /* Results of molecules finished by the previous run; empty charges mark molecules that failed */
+    [[nodiscard]] const std::map<size_t, std::vector<double>> &completed() const { return completed_; }
+
+    /* May be called concurrently */
+    void record(size_t index, const std::vector<double> &charges);
+
+    /* The computation is finished and its output written, the checkpoint is no longer needed */
+    void remove();
+};
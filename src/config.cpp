@@ -2,38 +2,127 @@
 
 #include "chargefw2.h"
 #include "config.h"
+#include "utility/compression.h"
+#include "utility/strings.h"
 
 
 namespace config {
     std::string mode;
     std::string input_file;
+    std::string input_list;
     std::string par_file;
     std::string chg_out_dir;
     std::string log_file;
     std::string method_name;
+    std::string output_compression = "none";
+    std::string cache_file;
+    std::string result_cache;
+    std::string socket_path;
+    std::string accuracy = "medium";
+    int threads = 0;
+    size_t max_memory = 0;
+    std::vector<std::string> output_formats;
     bool read_hetatm;
     bool ignore_water;
     bool permissive_types;
+    bool merge_cif_output;
+    bool checkpoint;
+    bool resume;
 }
 
 
 void check_common_args() {
-    if (config::mode != "available-methods" && config::input_file.empty()) {
+    if (config::mode != "available-methods" && config::mode != "serve" && config::input_file.empty() &&
+        (config::mode != "batch" || config::input_list.empty())) {
         std::println(stderr, "Input file must be provided");
         exit(to_int(ExitCode::ParameterError));
     }
 
-    if (config::mode == "best-parameters") {
+    if (config::mode != "batch" && not config::input_list.empty()) {
+        std::println(stderr, "List of input files can be used only in batch mode");
+        exit(to_int(ExitCode::ParameterError));
+    }
+
+    if (config::mode == "best-parameters" || config::mode == "plan") {
         if (config::method_name.empty()) {
             std::println(stderr, "No method selected.");
             exit(to_int(ExitCode::ParameterError));
         }
     }
 
-    if (config::mode == "charges") {
+    if (config::mode == "serve") {
+        if (config::socket_path.empty()) {
+            std::println(stderr, "Socket to listen on must be provided");
+            exit(to_int(ExitCode::ParameterError));
+        }
+    }
+
+    if (config::mode == "charges" || config::mode == "batch") {
         if (config::chg_out_dir.empty()) {
             std::println(stderr, "Directory where to store charges must be provided");
             exit(to_int(ExitCode::ParameterError));
         }
     }
+
+    if (config::mode == "charges") {
+        auto methods = split(config::method_name, ',');
+        auto par_files = split(config::par_file, ',');
+        if (methods.size() > 1 and not par_files.empty() and par_files.size() != methods.size()) {
+            std::println(stderr, "Number of parameter files must match the number of methods");
+            exit(to_int(ExitCode::ParameterError));
+        }
+    }
+
+    if (not config::result_cache.empty() and config::mode != "charges") {
+        std::println(stderr, "Result cache can be used only in charges mode");
+        exit(to_int(ExitCode::ParameterError));
+    }
+
+    if (config::checkpoint and config::mode != "charges") {
+        std::println(stderr, "Checkpoints can be used only in charges mode");
+        exit(to_int(ExitCode::ParameterError));
+    }
+
+    if (config::mode == "batch") {
+        if (config::method_name.empty()) {
+            std::println(stderr, "No method selected.");
+            exit(to_int(ExitCode::ParameterError));
+        }
+
+        if (not config::cache_file.empty()) {
+            std::println(stderr, "Binary cache cannot be used in batch mode");
+            exit(to_int(ExitCode::ParameterError));
+        }
+    }
+
+    if (config::output_compression != "none" and config::output_compression != "gzip" and
+        config::output_compression != "zstd") {
+        std::println(stderr, "Unknown output compression: {}", config::output_compression);
+        exit(to_int(ExitCode::ParameterError));
+    }
+
+    if (not compression_available(compression_from_name(config::output_compression))) {
+        std::println(stderr, "ChargeFW2 was built without {} support", config::output_compression);
+        exit(to_int(ExitCode::ParameterError));
+    }
+
+    if (config::threads < 0) {
+        std::println(stderr, "Number of threads must not be negative");
+        exit(to_int(ExitCode::ParameterError));
+    }
+
+    if (config::accuracy != "high" and config::accuracy != "medium" and config::accuracy != "low") {
+        std::println(stderr, "Unknown accuracy: {}", config::accuracy);
+        exit(to_int(ExitCode::ParameterError));
+    }
+
+    /* Each format is written once, however many times it was requested */
+    config::output_formats = unique(config::output_formats);
+    for (const auto &format: config::output_formats) {
+        if (format != "txt" and format != "cif" and format != "pqr" and format != "mol2" and
+            format != "npz") {
+            std::println(stderr, "Unknown output format: {}", format);
+            exit(to_int(ExitCode::ParameterError));
+        }
+    }
 }
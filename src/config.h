@@ -1,17 +1,31 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 namespace config {
     extern std::string mode;
     extern std::string input_file;
+    extern std::string input_list;
     extern std::string par_file;
     extern std::string chg_out_dir;
     extern std::string method_name;
     extern std::string log_file;
+    extern std::string output_compression;
+    extern std::string cache_file;
+    extern std::string result_cache;
+    extern std::string socket_path;
+    extern std::string accuracy;
+    extern int threads;
+    extern size_t max_memory;
+    extern std::vector<std::string> output_formats;
     extern bool read_hetatm;
     extern bool ignore_water;
     extern bool permissive_types;
+    extern bool merge_cif_output;
+    extern bool checkpoint;
+    extern bool resume;
 }
 
 
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <climits>
+#include <mutex>
+#include <numeric>
+#include <mpi.h>
+
+#include "distributed.h"
+#include "ee_method.h"
+#include "utility/exceptions.h"
+
+
+/* Charges computed by the other processes are sent to rank 0 as a sequence of (index, count, charges...) */
+static void gather_charges(const std::vector<double> &local, const ChargesCallback &callback, int rank, int size) {
+    if (local.size() > INT_MAX) {
+        throw InternalException("Too many charges to be sent at once");
+    }
+
+    const int count = static_cast<int>(local.size());
+    std::vector<int> counts(rank == 0 ? size : 0);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    std::vector<int> displacements(counts.size(), 0);
+    std::vector<double> all;
+    if (rank == 0) {
+        size_t total = 0;
+        for (size_t r = 0; r < counts.size(); r++) {
+            if (total > INT_MAX) {
+                throw InternalException("Too many charges to be sent at once");
+            }
+            displacements[r] = static_cast<int>(total);
+            total += static_cast<size_t>(counts[r]);
+        }
+        all.resize(total);
+    }
+
+    MPI_Gatherv(local.data(), count, MPI_DOUBLE, all.data(), counts.data(), displacements.data(), MPI_DOUBLE, 0,
+                MPI_COMM_WORLD);
+
+    size_t pos = 0;
+    while (pos < all.size()) {
+        const auto idx = static_cast<size_t>(all[pos]);
+        const auto n = static_cast<size_t>(all[pos + 1]);
+        pos += 2;
+        const auto begin = all.begin() + static_cast<long>(pos);
+        callback(idx, std::vector<double>(begin, begin + static_cast<long>(n)));
+        pos += n;
+    }
+}
+
+
+void calculate_charges_distributed(const Method &method, const MoleculeSet &ms, const ChargesCallback &callback) {
+    int rank = 0;
+    int size = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const auto &molecules = ms.molecules();
+    std::vector<size_t> order(molecules.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&molecules](size_t a, size_t b) {
+        return molecules[a].atoms().size() > molecules[b].atoms().size();
+    });
+    const size_t n = order.size();
+
+    size_t total_atoms = 0;
+    for (const auto &molecule: molecules) {
+        total_atoms += molecule.atoms().size();
+    }
+
+    /* A molecule which alone exceeds the share of a single process is computed by all of them. Every process takes the
+     * same steps, so only the selected mode (decided by rank 0) and the fragment results are exchanged */
+    auto &distribution = FragmentDistribution::global();
+    distribution = {static_cast<size_t>(rank), static_cast<size_t>(size), [](std::span<double> values) {
+        MPI_Allreduce(MPI_IN_PLACE, values.data(), static_cast<int>(values.size()), MPI_DOUBLE, MPI_SUM,
+                      MPI_COMM_WORLD);
+    }, [](size_t value) {
+        auto shared = static_cast<unsigned long>(value);
+        MPI_Bcast(&shared, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+        return static_cast<size_t>(shared);
+    }};
+
+    const auto processes = static_cast<size_t>(size);
+    size_t first_small = 0;
+    while (first_small < n and molecules[order[first_small]].atoms().size() * processes >= total_atoms) {
+        const size_t idx = order[first_small];
+        auto charges = method.calculate_charges(molecules[idx]);
+        if (rank == 0) {
+            callback(idx, std::move(charges));
+        }
+        first_small++;
+    }
+
+    distribution = {};
+
+    /* Greedy assignment of the remaining molecules, largest first, each to the process with the fewest atoms so far.
+     * All processes compute the same assignment, so it does not have to be communicated */
+    std::vector<size_t> loads(processes, 0);
+    std::vector<bool> selected(molecules.size(), false);
+    for (size_t k = first_small; k < n; k++) {
+        const size_t idx = order[k];
+        const auto target = static_cast<size_t>(std::ranges::min_element(loads) - loads.begin());
+        loads[target] += molecules[idx].atoms().size();
+        selected[idx] = target == static_cast<size_t>(rank);
+    }
+
+    std::mutex mutex;
+    std::vector<double> local;
+    calculate_all_charges(method, ms, [&](size_t i, std::vector<double> charges) {
+        if (rank == 0) {
+            callback(i, std::move(charges));
+            return;
+        }
+        std::lock_guard lock(mutex);
+        local.push_back(static_cast<double>(i));
+        local.push_back(static_cast<double>(charges.size()));
+        local.insert(local.end(), charges.begin(), charges.end());
+    }, selected);
+
+    gather_charges(local, callback, rank, size);
+}
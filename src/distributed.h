@@ -0,0 +1,12 @@
+#pragma once
+
+#include "executor.h"
+#include "method.h"
+#include "structures/molecule_set.h"
+
+
+/* Calculate charges of all molecules by all processes of MPI_COMM_WORLD, each holding the same molecule set and method.
+ * Molecules holding a substantial part of all atoms are computed by all processes together, with the fragments of
+ * cutoff and cover modes split among them; the rest are assigned to the processes by their size (largest first, each
+ * to the least loaded process). The callback is invoked only on rank 0, which receives the charges of all molecules */
+void calculate_charges_distributed(const Method &method, const MoleculeSet &ms, const ChargesCallback &callback);
@@ -3,34 +3,481 @@
 #include <string>
 #include <set>
 #include <print>
+#include <format>
+#include <numeric>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <optional>
+#include <cmath>
+#include <string_view>
 #include <omp.h>
+#include <unistd.h>
 
+#include "config.h"
 #include "ee_method.h"
 
 
+void FragmentStatistics::add(const std::vector<size_t> &sizes) {
+    if (sizes.empty()) {
+        return;
+    }
+
+    auto [min, max] = std::ranges::minmax(sizes);
+    std::lock_guard lock(mutex_);
+    min_ = count_ ? std::min(min_, min) : min;
+    max_ = std::max(max_, max);
+    count_ += sizes.size();
+    total_ += std::reduce(sizes.begin(), sizes.end(), size_t{0});
+}
+
+
+void FragmentStatistics::reset() {
+    std::lock_guard lock(mutex_);
+    count_ = total_ = min_ = max_ = 0;
+}
+
+
+size_t FragmentStatistics::count() const {
+    std::lock_guard lock(mutex_);
+    return count_;
+}
+
+
+void FragmentStatistics::print(FILE *file) const {
+    std::lock_guard lock(mutex_);
+    if (count_ == 0) {
+        return;
+    }
+    std::println(file, "Fragments: {}; Atoms per fragment: min {}, mean {:.1f}, max {}", count_, min_,
+                 static_cast<double>(total_) / static_cast<double>(count_), max_);
+}
+
+
+FragmentStatistics &FragmentStatistics::global() {
+    static FragmentStatistics statistics;
+    return statistics;
+}
+
+
+FragmentDistribution &FragmentDistribution::global() {
+    static FragmentDistribution distribution;
+    return distribution;
+}
+
+
+/* Upper bound on the number of atom pointers kept from the search in order_fragments_by_cost */
+constexpr size_t KEPT_FRAGMENT_ATOMS = size_t{1} << 24;
+
+
+/* Fragment centers in the order of their solve cost and the atoms found around each center; the atom lists are kept
+ * only while their total size stays below KEPT_FRAGMENT_ATOMS, an empty list means the fragment has to be searched
+ * again */
+struct OrderedFragments {
+    std::vector<size_t> order;
+    std::vector<std::vector<const Atom *>> atoms;
+};
+
+
+/* Order fragment centers by their solve cost (cubic in the fragment size), the most expensive first, so that
+ * no thread is left with a large fragment at the end of a dynamically scheduled loop */
+static OrderedFragments order_fragments_by_cost(const Molecule &molecule,
+                                                const std::vector<std::array<double, 3>> &centers, double radius) {
+    const size_t n = centers.size();
+    std::vector<size_t> sizes(n);
+    OrderedFragments fragments;
+    fragments.atoms.resize(n);
+    size_t kept = 0;
+
+#pragma omp parallel for default(none) shared(molecule, centers, sizes, radius, fragments, kept) firstprivate(n)
+    for (size_t i = 0; i < n; i++) {
+        auto atoms = molecule.get_close_atoms(centers[i], radius);
+        sizes[i] = atoms.size();
+
+        size_t previous;
+#pragma omp atomic capture
+        {
+            previous = kept;
+            kept += sizes[i];
+        }
+        if (previous + sizes[i] <= KEPT_FRAGMENT_ATOMS) {
+            fragments.atoms[i] = std::move(atoms);
+        }
+    }
+
+    FragmentStatistics::global().add(sizes);
+
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    /* Dealing the fragments round-robin in the order of cost gives every process a similar share of work */
+    const auto &distribution = FragmentDistribution::global();
+    if (distribution.size > 1) {
+        for (size_t k = distribution.rank; k < n; k += distribution.size) {
+            fragments.order.push_back(order[k]);
+        }
+    } else {
+        fragments.order = std::move(order);
+    }
+    return fragments;
+}
+
+
+/* Atoms of the fragment around the given atom with that atom first, taken from the search of the cost ordering if it
+ * was kept */
+static std::vector<const Atom *> atom_fragment(const Molecule &molecule, std::vector<const Atom *> &kept,
+                                               const Atom &atom, double radius) {
+    if (kept.empty()) {
+        return molecule.get_close_atoms(atom, radius);
+    }
+
+    auto atoms = std::move(kept);
+    if (auto it = std::ranges::find(atoms, &atom); it != atoms.end()) {
+        std::rotate(atoms.begin(), it, it + 1);
+    }
+    return atoms;
+}
+
+
+/* Bonded neighbors of each atom */
+static std::map<size_t, std::set<size_t>> bond_neighbors(const Molecule &molecule) {
+    std::map<size_t, std::set<size_t>> neighbors;
+    for (const auto &bond: molecule.bonds()) {
+        neighbors[bond.first().index()].insert(bond.second().index());
+        neighbors[bond.second().index()].insert(bond.first().index());
+    }
+    return neighbors;
+}
+
+
+/* Centers of the fragments in cover mode; atoms with the most bonds are taken first, each covering its neighbors */
+static std::vector<size_t> cover_pivots(const Molecule &molecule,
+                                        const std::map<size_t, std::set<size_t>> &neighbors) {
+    std::set<size_t> all;
+    for (size_t i = 0; i < molecule.atoms().size(); i++) {
+        all.insert(i);
+    }
+
+    std::map<size_t, std::set<size_t>> bonding_sizes;
+    for (const auto &[key, val]: neighbors) {
+        bonding_sizes[val.size()].insert(key);
+    }
+
+    std::set<size_t> pivots;
+    for (auto it = bonding_sizes.rbegin(); it != bonding_sizes.rend(); it++) {
+        for (const auto &idx: it->second) {
+            if (all.contains(idx)) {
+                pivots.insert(idx);
+                for (const auto &neighbor: neighbors.at(idx)) {
+                    all.erase(neighbor);
+                }
+            }
+        }
+    }
+
+    return {pivots.begin(), pivots.end()};
+}
+
+
+/* Central bonds of the fragments in cover mode of split-charge methods; bonds with the most adjacent bonds are taken
+ * first, each covering itself and its adjacent bonds */
+static std::vector<size_t> bond_cover_pivots(const Molecule &molecule, const AtomBonds &atom_bonds) {
+    const auto &bonds = molecule.bonds();
+    const size_t m = bonds.size();
+
+    std::vector<size_t> adjacent_count(m);
+    for (size_t k = 0; k < m; k++) {
+        adjacent_count[k] = atom_bonds.of(bonds[k].first().index()).size() +
+                            atom_bonds.of(bonds[k].second().index()).size();
+    }
+    std::vector<size_t> candidates(m);
+    std::iota(candidates.begin(), candidates.end(), 0);
+    std::ranges::stable_sort(candidates, [&adjacent_count](size_t a, size_t b) {
+        return adjacent_count[a] > adjacent_count[b];
+    });
+
+    std::vector<size_t> pivots;
+    std::vector<bool> covered(m, false);
+    for (const auto k: candidates) {
+        if (covered[k]) {
+            continue;
+        }
+        pivots.push_back(k);
+        for (const auto *atom: {&bonds[k].first(), &bonds[k].second()}) {
+            for (const auto j: atom_bonds.of(atom->index())) {
+                covered[j] = true;
+            }
+        }
+    }
+    return pivots;
+}
+
+
+/* Dense system of the given dimension (see EEMethod::system_size), solved by LU decomposition of a copy of the
+ * matrix */
+static double system_flops(size_t dimension) {
+    const auto m = static_cast<double>(dimension);
+    return 2.0 / 3.0 * m * m * m + 10.0 * m * m;
+}
+
+
+static double system_memory(size_t dimension) {
+    const auto m = static_cast<double>(dimension);
+    return 2.0 * sizeof(double) * m * m;
+}
+
+
+/* Fragment sizes are evaluated for at most SAMPLE_SIZE evenly spaced centers and scaled to all of them. The dimension
+ * of the system of a fragment is given by the number of its atoms */
+static SolverCost fragment_cost(const Molecule &molecule, const std::vector<std::array<double, 3>> &centers,
+                                double radius, const std::function<size_t(size_t)> &dimension, std::string mode) {
+    constexpr size_t SAMPLE_SIZE = 64;
+    const size_t step = std::max<size_t>(1, centers.size() / SAMPLE_SIZE);
+
+    SolverCost cost{std::move(mode), centers.size()};
+    size_t sampled = 0;
+    for (size_t i = 0; i < centers.size(); i += step) {
+        const size_t size = molecule.get_close_atoms(centers[i], radius).size();
+        cost.fragment_atoms = std::max(cost.fragment_atoms, size);
+        cost.flops += system_flops(dimension(size));
+        sampled++;
+    }
+
+    if (sampled) {
+        cost.flops *= static_cast<double>(centers.size()) / static_cast<double>(sampled);
+    }
+
+    /* Fragments are solved concurrently unless the molecule itself is one of many computed in parallel */
+    const auto concurrent = omp_in_parallel() ? size_t{1} : static_cast<size_t>(omp_get_max_threads());
+    cost.memory = static_cast<double>(std::min(concurrent, centers.size())) *
+                  system_memory(dimension(cost.fragment_atoms)) +
+                  2.0 * sizeof(double) * static_cast<double>(molecule.atoms().size());
+    return cost;
+}
+
+
+static double solver_memory_limit() {
+    if (config::max_memory != 0) {
+        return static_cast<double>(config::max_memory);
+    }
+    return 0.75 * static_cast<double>(sysconf(_SC_PHYS_PAGES)) * static_cast<double>(sysconf(_SC_PAGE_SIZE));
+}
+
+
+double available_solver_memory() {
+    auto memory = solver_memory_limit();
+
+    /* Molecules computed in parallel share the memory */
+    if (omp_in_parallel()) {
+        memory /= omp_get_num_threads();
+    }
+    return memory;
+}
+
+
+std::string solver_settings(const EEMethod &method) {
+    auto settings = std::format("accuracy={}", config::accuracy);
+    if (method.get_option_value<std::string>("type") == "auto" and config::max_memory != 0) {
+        settings += std::format(";memory={}", config::max_memory);
+    }
+    return settings;
+}
+
+
 bool EEMethod::is_suitable_for_large_molecule() const {
     return true;
 }
 
 
-Eigen::VectorXd EEMethod::solve_EE(const Molecule &molecule,
-        const std::function<Eigen::VectorXd(const std::vector<const Atom *> &, double)> &EE_function) const {
+SolverCost EEMethod::full_cost(const Molecule &molecule) const {
+    const size_t n = molecule.atoms().size();
+    const size_t m = molecule.bonds().size();
+    const size_t dimension = system_size(n, m);
 
-    auto method = get_option_value<std::string>("type");
-    auto radius = get_option_value<double>("radius");
+    SolverCost cost{"full", 1, n, system_memory(dimension), system_flops(dimension)};
 
-    if (method != "cover" and molecule.atoms().size() > 80000) {
-        std::println("Switching to cover as the molecule is too big");
-        std::println("Using radius {}", radius);
-        method = "cover";
-    } else if (method == "full" and molecule.atoms().size() > 20000) {
-        std::println("Switching to cutoff as the molecule is too big");
-        std::println("Using radius {}", radius);
-        method = "cutoff";
+    /* Split-charge systems which do not fit are solved by conjugate gradients (see SQESystem::solve): a few vectors
+     * and, in every iteration, a product evaluating the kernel of each pair of atoms */
+    if (uses_split_charges() and cost.memory > available_solver_memory()) {
+        constexpr double ITERATIONS = 100;
+        constexpr double KERNEL_FLOPS = 30;
+        const auto atoms = static_cast<double>(n);
+        cost.memory = 10.0 * sizeof(double) * static_cast<double>(n + m);
+        cost.flops = ITERATIONS * KERNEL_FLOPS * atoms * atoms;
     }
+    return cost;
+}
+
+
+std::vector<SolverCost> EEMethod::estimate_costs(const Molecule &molecule, std::vector<size_t> *pivots) const {
+    const auto radius = get_option_value<double>("radius");
+    const size_t n = molecule.atoms().size();
+    const auto &bonds = molecule.bonds();
+
+    /* Fragments are assumed to have as many bonds per atom as the whole molecule */
+    const double bonds_per_atom = n ? static_cast<double>(bonds.size()) / static_cast<double>(n) : 0.0;
+    auto dimension = [this, bonds_per_atom](size_t atoms) {
+        return system_size(atoms, static_cast<size_t>(std::lround(bonds_per_atom * static_cast<double>(atoms))));
+    };
+
+    /* Split-charge methods center their fragments at bonds (see solve_split_EE) */
+    std::vector<std::array<double, 3>> centers;
+    std::vector<size_t> cover_indices;
+    std::vector<std::array<double, 3>> cover_centers;
+    if (uses_split_charges()) {
+        for (const auto &bond: bonds) {
+            centers.push_back(bond.get_center());
+        }
+        cover_indices = bond_cover_pivots(molecule, AtomBonds(molecule));
+        for (const auto k: cover_indices) {
+            cover_centers.push_back(bonds[k].get_center());
+        }
+    } else {
+        for (const auto &atom: molecule.atoms()) {
+            centers.push_back(atom.pos());
+        }
+        cover_indices = cover_pivots(molecule, bond_neighbors(molecule));
+        for (const auto idx: cover_indices) {
+            cover_centers.push_back(molecule.atoms()[idx].pos());
+        }
+    }
+
+    auto cutoff = fragment_cost(molecule, centers, radius, dimension, "cutoff");
+    auto cover = fragment_cost(molecule, cover_centers, radius, dimension, "cover");
+    if (pivots != nullptr) {
+        *pivots = std::move(cover_indices);
+    }
+
+    return {full_cost(molecule), cutoff, cover};
+}
+
+
+std::optional<SolverCost> EEMethod::obvious_mode(const Molecule &molecule, double available_memory) const {
+    /* The full solve of a molecule this small takes a fraction of a second, so whatever the fragments would save is
+     * not worth estimating */
+    constexpr size_t SMALL_MOLECULE = 1000;
+
+    const auto type = get_option_value<std::string>("type");
+    const auto radius = get_option_value<double>("radius");
+    const size_t n = molecule.atoms().size();
+    const size_t dimension = system_size(n, molecule.bonds().size());
 
+    const auto full = full_cost(molecule);
+
+    /* An explicit type fits if even fragments of the whole molecule do */
+    if (type != "auto") {
+        const auto concurrent = omp_in_parallel() ? size_t{1} : static_cast<size_t>(omp_get_max_threads());
+        const auto memory = type == "full" ? full.memory
+                                           : static_cast<double>(std::min(concurrent, n)) * system_memory(dimension);
+        if (memory <= available_memory) {
+            return SolverCost{type, 0, n, memory, 0};
+        }
+        return std::nullopt;
+    }
+
+    if (full.memory > available_memory) {
+        return std::nullopt;
+    }
+
+    /* Fragments of a molecule within the radius are the whole molecule, the full mode solves it just once */
+    std::array<double, 3> min{}, max{};
+    if (n != 0) {
+        min = max = molecule.atoms().front().pos();
+    }
+    for (const auto &atom: molecule.atoms()) {
+        for (size_t d = 0; d < 3; d++) {
+            min[d] = std::min(min[d], atom.pos()[d]);
+            max[d] = std::max(max[d], atom.pos()[d]);
+        }
+    }
+    const double extent = std::hypot(max[0] - min[0], max[1] - min[1], max[2] - min[2]);
+
+    if (n <= SMALL_MOLECULE or extent <= radius) {
+        return full;
+    }
+    return std::nullopt;
+}
+
+
+const SolverCost &EEMethod::select_mode(const std::vector<SolverCost> &costs, double available_memory) const {
+    const auto type = get_option_value<std::string>("type");
+
+    /* The modes are ordered by accuracy; each accuracy level allows one more of them */
+    size_t first = 0;
+    size_t last = 0;
+    if (type == "auto") {
+        last = config::accuracy == "high" ? 1 : config::accuracy == "medium" ? 2 : costs.size();
+    } else {
+        while (first < costs.size() and costs[first].mode != type) {
+            first++;
+        }
+        last = first + 1;
+    }
+
+    const SolverCost *best = nullptr;
+    for (size_t k = first; k < std::min(last, costs.size()); k++) {
+        if (costs[k].memory <= available_memory and (best == nullptr or costs[k].flops < best->flops)) {
+            best = &costs[k];
+        }
+    }
+    if (best) {
+        return *best;
+    }
+
+    for (const auto &cost: costs) {
+        if (cost.memory <= available_memory) {
+            return cost;
+        }
+    }
+
+    return *std::ranges::min_element(costs, {}, &SolverCost::memory);
+}
+
+
+std::string EEMethod::select_type(const Molecule &molecule, std::vector<size_t> &pivots) const {
+    static constexpr std::array<std::string_view, 3> MODES = {"full", "cutoff", "cover"};
+    const auto type = get_option_value<std::string>("type");
+
+    const auto available_memory = available_solver_memory();
+    auto selected = obvious_mode(molecule, available_memory);
+    if (not selected) {
+        selected = select_mode(estimate_costs(molecule, &pivots), available_memory);
+    }
+
+    /* Processes sharing the fragments may see different memory and thread counts, but must solve the same ones */
+    const auto &distribution = FragmentDistribution::global();
+    if (distribution.size > 1) {
+        const auto index = distribution.agree(static_cast<size_t>(std::ranges::find(MODES, selected->mode) -
+                                                                  MODES.begin()));
+        if (distribution.rank != 0) {
+            if (MODES[index] != selected->mode) {
+                pivots.clear();
+            }
+            return std::string(MODES[index]);
+        }
+    }
+
+    if (selected->memory > available_memory) {
+        std::println(stderr, "{}: {} mode needs {:.0f} MB, more than the available {:.0f} MB", molecule.name(),
+                     selected->mode, selected->memory / 1e6, available_memory / 1e6);
+    } else if (type != "auto" and selected->mode != type) {
+        std::println(stderr, "{}: switching to {} mode as {} mode needs more than the available {:.0f} MB",
+                     molecule.name(), selected->mode, type, available_memory / 1e6);
+    }
+    return selected->mode;
+}
+
+
+Eigen::VectorXd EEMethod::solve_EE(const Molecule &molecule,
+        const std::function<Eigen::VectorXd(const std::vector<const Atom *> &, double)> &EE_function) const {
+
+    const auto radius = get_option_value<double>("radius");
+    std::vector<size_t> pivots;
+    const auto method = select_type(molecule, pivots);
+
+    /* Eigen parallelizes only outside of OpenMP regions, so the fragment loops below keep their solvers serial */
     if (method == "full") {
-        Eigen::setNbThreads(0);
         std::vector<const Atom *> fragment_atoms;
         for (const auto &atom: molecule.atoms()) {
             fragment_atoms.push_back(&atom);
@@ -41,17 +488,29 @@ Eigen::VectorXd EEMethod::solve_EE(const Molecule &molecule,
     } else if (method == "cutoff") {
         const size_t n = molecule.atoms().size();
         Eigen::VectorXd results = Eigen::VectorXd::Zero(n);
-        Eigen::setNbThreads(1);
 
-#pragma omp parallel for default(none) shared(results, radius, molecule, EE_function) firstprivate(n)
-        for (size_t i = 0; i < n; i++) {
-            auto fragment_atoms = molecule.get_close_atoms(molecule.atoms()[i], radius);
+        std::vector<std::array<double, 3>> centers;
+        for (const auto &atom: molecule.atoms()) {
+            centers.push_back(atom.pos());
+        }
+        auto fragments = order_fragments_by_cost(molecule, centers, radius);
+        const auto &order = fragments.order;
+        const size_t count = order.size();
+
+#pragma omp parallel for schedule(dynamic, 1) default(none) shared(results, radius, molecule, EE_function, order, fragments) firstprivate(count)
+        for (size_t k = 0; k < count; k++) {
+            const size_t i = order[k];
+            auto fragment_atoms = atom_fragment(molecule, fragments.atoms[i], molecule.atoms()[i], radius);
             Eigen::VectorXd res = EE_function(fragment_atoms,
                                     static_cast<double>(molecule.total_charge()) * fragment_atoms.size() /
                                     molecule.atoms().size());
             results(i) = res(0);
         }
 
+        if (const auto &distribution = FragmentDistribution::global(); distribution.size > 1) {
+            distribution.sum({results.data(), n});
+        }
+
         double correction = molecule.total_charge() - results.sum();
         correction /= molecule.atoms().size();
 
@@ -59,49 +518,33 @@ Eigen::VectorXd EEMethod::solve_EE(const Molecule &molecule,
         return results;
 
     } else /* method == "cover" */ {
-        Eigen::setNbThreads(1);
-
         const size_t n = molecule.atoms().size();
 
-        /* 1st step - identify pivots */
-        std::map<size_t, std::set<size_t>> neighbors;
-        for (const auto &bond: molecule.bonds()) {
-            neighbors[bond.first().index()].insert(bond.second().index());
-            neighbors[bond.second().index()].insert(bond.first().index());
-        }
-
-        std::set<size_t> all;
-        for (size_t i = 0; i < n; i++) {
-            all.insert(i);
+        /* 1st step - identify pivots, unless the cost model already did */
+        auto neighbors = bond_neighbors(molecule);
+        if (pivots.empty()) {
+            pivots = cover_pivots(molecule, neighbors);
         }
-
-        std::map<size_t, std::set<size_t>> bonding_sizes;
-        for (const auto &[key, val]: neighbors) {
-            bonding_sizes[val.size()].insert(key);
-        }
-
-        std::set<const Atom *> pivots;
-        for (auto it = bonding_sizes.rbegin(); it != bonding_sizes.rend(); it++) {
-            for (const auto &idx: it->second) {
-                if (all.contains(idx)) {
-                    pivots.insert(&molecule.atoms()[idx]);
-                    for (const auto &neighbor: neighbors[idx]) {
-                        all.erase(neighbor);
-                    }
-                }
-            }
+        std::vector<const Atom *> pivots_vector;
+        for (const auto idx: pivots) {
+            pivots_vector.push_back(&molecule.atoms()[idx]);
         }
 
         /* 2nd step - solve EEM for fragments, sum up charges */
         Eigen::VectorXd results = Eigen::VectorXd::Zero(n);
-        std::vector<int> charges_count(n, 0);
+        Eigen::VectorXd charges_count = Eigen::VectorXd::Zero(n);
 
-        std::vector<const Atom *> pivots_vector(pivots.begin(), pivots.end());
+        std::vector<std::array<double, 3>> centers;
+        for (const auto *pivot: pivots_vector) {
+            centers.push_back(pivot->pos());
+        }
+        auto fragments = order_fragments_by_cost(molecule, centers, radius);
+        const auto &order = fragments.order;
 
-#pragma omp parallel for default(none) shared(radius, pivots_vector, neighbors, molecule, charges_count, results, EE_function) firstprivate(n)
-        for (size_t i = 0; i < pivots_vector.size(); i++) {
-            auto &atom = pivots_vector[i];
-            auto fragment_atoms = molecule.get_close_atoms(*atom, radius);
+#pragma omp parallel for schedule(dynamic, 1) default(none) shared(radius, pivots_vector, neighbors, molecule, charges_count, results, EE_function, order, fragments) firstprivate(n)
+        for (size_t k = 0; k < order.size(); k++) {
+            auto &atom = pivots_vector[order[k]];
+            auto fragment_atoms = atom_fragment(molecule, fragments.atoms[order[k]], *atom, radius);
             Eigen::VectorXd res = EE_function(fragment_atoms,
                                     static_cast<double>(molecule.total_charge()) * fragment_atoms.size() / n);
 
@@ -115,7 +558,7 @@ Eigen::VectorXd EEMethod::solve_EE(const Molecule &molecule,
 
             for (const auto &j: close_atoms) {
 #pragma omp atomic
-                charges_count[j]++;
+                charges_count(j) += 1;
             }
 
             for (size_t j = 0; j < fragment_atoms.size(); j++) {
@@ -126,13 +569,177 @@ Eigen::VectorXd EEMethod::solve_EE(const Molecule &molecule,
             }
         }
 
-        for (long i = 0; i < results.size(); i++) {
-            results(i) /= charges_count[i];
+        if (const auto &distribution = FragmentDistribution::global(); distribution.size > 1) {
+            distribution.sum({results.data(), n});
+            distribution.sum({charges_count.data(), n});
         }
 
+        results.array() /= charges_count.array();
+
         /* 3rd step - correct charges */
         auto correction = (molecule.total_charge() - results.sum()) / n;
         results.array() += correction;
         return results;
     }
 }
+
+
+AtomBonds::AtomBonds(const Molecule &molecule) : offsets_(molecule.atoms().size() + 1, 0) {
+    const auto &bonds = molecule.bonds();
+    for (const auto &bond: bonds) {
+        offsets_[bond.first().index() + 1]++;
+        offsets_[bond.second().index() + 1]++;
+    }
+    std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+
+    bond_ids_.resize(offsets_.back());
+    auto next = offsets_;
+    for (size_t k = 0; k < bonds.size(); k++) {
+        bond_ids_[next[bonds[k].first().index()]++] = k;
+        bond_ids_[next[bonds[k].second().index()]++] = k;
+    }
+}
+
+
+std::vector<FragmentBond> fragment_bonds(const Molecule &molecule, const AtomBonds &atom_bonds,
+                                         const std::vector<const Atom *> &atoms) {
+    std::unordered_map<size_t, size_t> positions;
+    for (size_t i = 0; i < atoms.size(); i++) {
+        positions[atoms[i]->index()] = i;
+    }
+
+    /* Each bond is found from its first atom */
+    std::vector<FragmentBond> result;
+    for (size_t i = 0; i < atoms.size(); i++) {
+        for (const auto k: atom_bonds.of(atoms[i]->index())) {
+            const auto &bond = molecule.bonds()[k];
+            if (&bond.first() != atoms[i]) {
+                continue;
+            }
+            if (auto it = positions.find(bond.second().index()); it != positions.end()) {
+                result.push_back({&bond, i, it->second});
+            }
+        }
+    }
+    return result;
+}
+
+
+/* Atoms within the radius of the center together with the atoms of the central bond and its adjacent bonds, and all
+ * bonds between them with the central bond first; the atoms within the radius are taken from the search of the cost
+ * ordering if it was kept */
+static std::pair<std::vector<const Atom *>, std::vector<FragmentBond>>
+bond_fragment(const Molecule &molecule, const AtomBonds &atom_bonds, std::vector<const Atom *> &kept, size_t central,
+              double radius) {
+    const auto &bonds = molecule.bonds();
+    const auto &bond = bonds[central];
+
+    auto atoms = kept.empty() ? molecule.get_close_atoms(bond.get_center(), radius) : std::move(kept);
+    for (const auto *atom: {&bond.first(), &bond.second()}) {
+        for (const auto k: atom_bonds.of(atom->index())) {
+            for (const auto *end: {&bonds[k].first(), &bonds[k].second()}) {
+                if (std::ranges::find(atoms, end) == atoms.end()) {
+                    atoms.push_back(end);
+                }
+            }
+        }
+    }
+
+    auto bonds_of_fragment = fragment_bonds(molecule, atom_bonds, atoms);
+    auto it = std::ranges::find(bonds_of_fragment, &bond, &FragmentBond::bond);
+    std::iter_swap(bonds_of_fragment.begin(), it);
+
+    return {std::move(atoms), std::move(bonds_of_fragment)};
+}
+
+
+Eigen::VectorXd EEMethod::solve_split_EE(const Molecule &molecule,
+        const std::function<Eigen::VectorXd(const std::vector<const Atom *> &, const std::vector<FragmentBond> &)>
+        &split_function) const {
+
+    const auto radius = get_option_value<double>("radius");
+    std::vector<size_t> pivots;
+    const auto method = select_type(molecule, pivots);
+    const auto &bonds = molecule.bonds();
+    const size_t m = bonds.size();
+
+    if (method == "full" or m == 0) {
+        std::vector<const Atom *> atoms;
+        for (const auto &atom: molecule.atoms()) {
+            atoms.push_back(&atom);
+        }
+
+        std::vector<FragmentBond> all_bonds;
+        for (const auto &bond: bonds) {
+            all_bonds.push_back({&bond, bond.first().index(), bond.second().index()});
+        }
+
+        return split_function(atoms, all_bonds);
+    }
+
+    const AtomBonds atom_bonds(molecule);
+
+    /* Bonds sharing an atom with the given one */
+    auto adjacent = [&bonds, &atom_bonds](size_t k) {
+        std::set<size_t> result;
+        for (const auto *atom: {&bonds[k].first(), &bonds[k].second()}) {
+            for (const auto j: atom_bonds.of(atom->index())) {
+                result.insert(j);
+            }
+        }
+        return result;
+    };
+
+    std::vector<size_t> central_bonds;
+    if (method == "cutoff") {
+        central_bonds.resize(m);
+        std::iota(central_bonds.begin(), central_bonds.end(), 0);
+    } else /* method == "cover" */ {
+        /* Unless the cost model already found them */
+        central_bonds = pivots.empty() ? bond_cover_pivots(molecule, atom_bonds) : std::move(pivots);
+    }
+
+    std::vector<std::array<double, 3>> centers;
+    for (const auto k: central_bonds) {
+        centers.push_back(bonds[k].get_center());
+    }
+    auto fragments = order_fragments_by_cost(molecule, centers, radius);
+    const auto &order = fragments.order;
+
+    Eigen::VectorXd results = Eigen::VectorXd::Zero(static_cast<Eigen::Index>(m));
+    Eigen::VectorXd charges_count = Eigen::VectorXd::Zero(static_cast<Eigen::Index>(m));
+    const bool cover = method == "cover";
+
+#pragma omp parallel for schedule(dynamic, 1) default(none) shared(molecule, atom_bonds, central_bonds, order, fragments, radius, split_function, adjacent, results, charges_count, cover)
+    for (size_t i = 0; i < order.size(); i++) {
+        const size_t central = central_bonds[order[i]];
+        const auto [atoms, bonds_of_fragment] = bond_fragment(molecule, atom_bonds, fragments.atoms[order[i]], central,
+                                                              radius);
+        Eigen::VectorXd res = split_function(atoms, bonds_of_fragment);
+
+        if (not cover) {
+            results(static_cast<Eigen::Index>(central)) = res(0);
+            charges_count(static_cast<Eigen::Index>(central)) = 1;
+            continue;
+        }
+
+        const auto kept = adjacent(central);
+        for (size_t j = 0; j < bonds_of_fragment.size(); j++) {
+            const auto k = static_cast<Eigen::Index>(bonds_of_fragment[j].bond - molecule.bonds().data());
+            if (kept.contains(static_cast<size_t>(k))) {
+#pragma omp atomic
+                results(k) += res(static_cast<Eigen::Index>(j));
+#pragma omp atomic
+                charges_count(k) += 1;
+            }
+        }
+    }
+
+    if (const auto &distribution = FragmentDistribution::global(); distribution.size > 1) {
+        distribution.sum({results.data(), m});
+        distribution.sum({charges_count.data(), m});
+    }
+
+    results.array() /= charges_count.array();
+    return results;
+}
@@ -3,15 +3,117 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <optional>
+#include <cstdio>
 #include <functional>
+#include <mutex>
+#include <span>
 #include <Eigen/Core>
 
 #include "method.h"
 
+/* Sizes of the fragments solved in cutoff and cover modes, accumulated over the whole run */
+class FragmentStatistics {
+    mutable std::mutex mutex_{};
+    size_t count_{0};
+    size_t total_{0};
+    size_t min_{0};
+    size_t max_{0};
+
+public:
+    void add(const std::vector<size_t> &sizes);
+
+    void reset();
+
+    [[nodiscard]] size_t count() const;
+
+    /* Prints nothing if no fragments were solved */
+    void print(FILE *file) const;
+
+    static FragmentStatistics &global();
+};
+
+
+/* Splits the fragments of cutoff and cover modes among cooperating processes (see distributed.h). Each process solves
+ * every size-th fragment in the order of cost, starting with its rank; sum adds up the partial results of all processes
+ * in place and agree returns the value given by rank 0, so that all processes select the same mode. The default solves
+ * all fragments locally */
+struct FragmentDistribution {
+    size_t rank{0};
+    size_t size{1};
+    std::function<void(std::span<double>)> sum{};
+    std::function<size_t(size_t)> agree{};
+
+    static FragmentDistribution &global();
+};
+
+
+/* Predicted cost of computing a molecule in one of the modes of EEMethod::solve_EE. Fragment sizes are estimated from
+ * a sample of fragment centers; memory includes all systems solved at the same time */
+struct SolverCost {
+    std::string mode;
+    size_t fragments{0};
+    size_t fragment_atoms{0};
+    double memory{0};
+    double flops{0};
+};
+
+
+/* Memory for solving one molecule: --max-memory (or three quarters of the physical memory) shared by the molecules
+ * computed in parallel */
+[[nodiscard]] double available_solver_memory();
+
+
+class EEMethod;
+
+
+/* Settings other than the method options on which the charges computed by the method depend, for identifying stored
+ * results: --accuracy and, in auto type, an explicit --max-memory. The physical memory and the number of threads are
+ * left out so that the results are reused on other machines */
+[[nodiscard]] std::string solver_settings(const EEMethod &method);
+
+
+/* Bond of a fragment given by the positions of its atoms in the list of fragment atoms */
+struct FragmentBond {
+    const Bond *bond;
+    size_t first;
+    size_t second;
+};
+
+
+/* Bonds of each atom of a molecule in a compressed row layout */
+class AtomBonds {
+    std::vector<size_t> offsets_;
+    std::vector<size_t> bond_ids_;
+
+public:
+    explicit AtomBonds(const Molecule &molecule);
+
+    /* Indices of the bonds of the atom with the given index */
+    [[nodiscard]] std::span<const size_t> of(size_t atom) const {
+        return {bond_ids_.data() + offsets_[atom], offsets_[atom + 1] - offsets_[atom]};
+    }
+};
+
+
+/* Bonds of the molecule between the given atoms */
+[[nodiscard]] std::vector<FragmentBond> fragment_bonds(const Molecule &molecule, const AtomBonds &atom_bonds,
+                                                       const std::vector<const Atom *> &atoms);
+
+
 class EEMethod : public Method {
+    /* Mode selected for the molecule by the cost model, reporting when it differs from the requested one. The cover
+     * pivots are stored in pivots if the model computed them */
+    [[nodiscard]] std::string select_type(const Molecule &molecule, std::vector<size_t> &pivots) const;
+
+    [[nodiscard]] SolverCost full_cost(const Molecule &molecule) const;
+
+    /* Mode which is clearly the right one without estimating the costs of the others, if there is such */
+    [[nodiscard]] std::optional<SolverCost> obvious_mode(const Molecule &molecule, double available_memory) const;
+
     [[nodiscard]] std::map<std::string, MethodOption>
     augment_options(std::map<std::string, MethodOption> options) const {
-        options["type"] = {"type", "Type of a solver", "str", "full", {"full", "cutoff", "cover"}};
+        options["type"] = {"type", "Type of a solver", "str", "auto", {"auto", "full", "cutoff", "cover"}};
         options["radius"] = {"radius", "Radius for cutoff", "double", "12", {}};
         return options;
     }
@@ -25,10 +127,41 @@ public:
 
     [[nodiscard]] bool is_suitable_for_large_molecule() const override;
 
+    /* Dimension of the dense system solved for a fragment with the given numbers of atoms and bonds; the default is
+     * one equation per atom and the total charge constraint */
+    [[nodiscard]] virtual size_t system_size(size_t atoms, [[maybe_unused]] size_t bonds) const {
+        return atoms + 1;
+    }
+
+    /* Split-charge methods solve for bonds with solve_split_EE, their fragments are centered at bonds and the full
+     * system is solved iteratively if it does not fit into the memory */
+    [[nodiscard]] virtual bool uses_split_charges() const {
+        return false;
+    }
+
+    /* Costs of the full, cutoff and cover modes (in this order) for the given molecule; the cover pivots (indices of
+     * atoms, or bonds for split-charge methods) are stored in pivots if given */
+    [[nodiscard]] std::vector<SolverCost> estimate_costs(const Molecule &molecule,
+                                                         std::vector<size_t> *pivots = nullptr) const;
+
+    /* The fastest mode allowed by the type option and --accuracy (for auto) which fits into the memory available to
+     * a single molecule. If the allowed modes do not fit, the most accurate mode that fits is used instead; if none
+     * fits, the one requiring the least memory */
+    [[nodiscard]] const SolverCost &select_mode(const std::vector<SolverCost> &costs, double available_memory) const;
+
     [[nodiscard]] Eigen::VectorXd solve_EE(const Molecule& molecule,
                                            const std::function<Eigen::VectorXd(const std::vector<const Atom*>&, double)>
                                            &) const;
 
+    /* Split charges of all bonds for split-charge methods. The function returns split charges of the given fragment
+     * bonds; in cutoff mode the fragments are spheres around bond centers, of which only the central bond is kept, in
+     * cover mode around pivot bonds, keeping the pivot and its adjacent bonds (averaged over fragments). Split charges
+     * conserve the total charge, so no correction is needed */
+    [[nodiscard]] Eigen::VectorXd solve_split_EE(const Molecule &molecule,
+                                                 const std::function<Eigen::VectorXd(const std::vector<const Atom *> &,
+                                                                                     const std::vector<FragmentBond> &)>
+                                                 &) const;
+
     [[nodiscard]] std::vector<RequiredFeatures> get_requirements() const override {
         return {RequiredFeatures::DISTANCE_TREE};
     }
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <exception>
+#include <omp.h>
+
+#include "executor.h"
+
+
+void set_thread_count(int threads) {
+    omp_set_max_active_levels(1);
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+}
+
+
+void calculate_all_charges(const Method &method, const MoleculeSet &ms, const ChargesCallback &callback,
+                           const std::vector<bool> &selected) {
+    const auto &molecules = ms.molecules();
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < molecules.size(); i++) {
+        if (selected.empty() or selected[i]) {
+            order.push_back(i);
+        }
+    }
+    std::ranges::stable_sort(order, [&molecules](size_t a, size_t b) {
+        return molecules[a].atoms().size() > molecules[b].atoms().size();
+    });
+    const size_t n = order.size();
+
+    size_t total_atoms = 0;
+    for (auto idx: order) {
+        total_atoms += molecules[idx].atoms().size();
+    }
+
+    /* Molecules which alone exceed the share of a single thread would dominate the run time if given only one */
+    const auto threads = static_cast<size_t>(omp_get_max_threads());
+    size_t first_small = 0;
+    while (first_small < n and molecules[order[first_small]].atoms().size() * threads >= total_atoms) {
+        const size_t idx = order[first_small];
+        callback(idx, method.calculate_charges(molecules[idx]));
+        first_small++;
+    }
+
+    /* Parallel regions inside the method (including Eigen) are nested here and therefore run on a single thread */
+    std::exception_ptr error;
+
+    #pragma omp parallel for schedule(dynamic, 1) default(none) shared(method, molecules, order, callback, error) firstprivate(n, first_small)
+    for (size_t i = first_small; i < n; i++) {
+        try {
+            const size_t idx = order[i];
+            callback(idx, method.calculate_charges(molecules[idx]));
+        } catch (...) {
+            #pragma omp critical
+            if (not error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "method.h"
+#include "structures/molecule_set.h"
+
+
+/* Receives charges of the molecule with the given index; called concurrently from worker threads */
+using ChargesCallback = std::function<void(size_t, std::vector<double>)>;
+
+/* Set the number of threads used by OpenMP loops and Eigen in the calling thread (0 keeps the default);
+ * nested parallel regions are serialized so that the levels never oversubscribe the cores */
+void set_thread_count(int threads);
+
+/* Calculate charges of all molecules, largest first. A molecule holding a substantial part of all atoms runs alone so
+ * that the method can use every thread, the remaining ones are distributed dynamically one molecule per thread.
+ * If a selection is given, only the molecules marked in it are calculated */
+void calculate_all_charges(const Method &method, const MoleculeSet &ms, const ChargesCallback &callback,
+                           const std::vector<bool> &selected = {});
@@ -0,0 +1,453 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include "bcif.h"
+#include "msgpack.h"
+#include "common.h"
+#include "bonds.h"
+#include "../structures/atom.h"
+#include "../structures/bond.h"
+#include "../periodic_table.h"
+#include "../utility/exceptions.h"
+#include "../utility/compression.h"
+
+
+/* See https://github.com/molstar/BinaryCIF/blob/master/encoding.md for the description of the encodings */
+
+namespace {
+    enum class ByteArrayType : int {
+        Int8 = 1,
+        Int16 = 2,
+        Int32 = 3,
+        Uint8 = 4,
+        Uint16 = 5,
+        Uint32 = 6,
+        Float32 = 32,
+        Float64 = 33
+    };
+
+    /* Intermediate result of the decoding, either integers or floating point numbers */
+    struct DecodedData {
+        std::vector<int64_t> ints;
+        std::vector<double> floats;
+        bool is_float{false};
+    };
+
+    /* Fully decoded column; strings point into the mapped file */
+    struct Column {
+        std::vector<std::string_view> strings;
+        DecodedData numbers;
+        std::vector<uint8_t> mask;
+        bool is_string{false};
+
+        /* Mask value 0 means the value is present, 1 is '.' and 2 is '?' */
+        [[nodiscard]] bool present(size_t i) const { return mask.empty() or mask[i] == 0; }
+
+        [[nodiscard]] std::string_view string(size_t i) const {
+            return present(i) and is_string ? strings[i] : std::string_view{};
+        }
+
+        [[nodiscard]] int64_t integer(size_t i) const {
+            if (not present(i)) {
+                return 0;
+            }
+            if (is_string) {
+                return std::stoll(std::string(strings[i]));
+            }
+            return numbers.is_float ? static_cast<int64_t>(numbers.floats[i]) : numbers.ints[i];
+        }
+
+        [[nodiscard]] double number(size_t i) const {
+            if (not present(i)) {
+                return 0;
+            }
+            if (is_string) {
+                return std::stod(std::string(strings[i]));
+            }
+            return numbers.is_float ? numbers.floats[i] : static_cast<double>(numbers.ints[i]);
+        }
+    };
+
+
+    template<typename T>
+    void read_little_endian(std::string_view bytes, std::vector<T> &out) {
+        if (bytes.size() % sizeof(T) != 0) {
+            throw std::runtime_error("Invalid size of ByteArray data");
+        }
+
+        out.resize(bytes.size() / sizeof(T));
+        std::memcpy(out.data(), bytes.data(), bytes.size());
+        if constexpr (std::endian::native == std::endian::big and sizeof(T) > 1) {
+            for (auto &value: out) {
+                value = std::byteswap(value);
+            }
+        }
+    }
+
+
+    template<typename T, typename U>
+    void widen(std::string_view bytes, std::vector<U> &out) {
+        std::vector<T> raw;
+        read_little_endian(bytes, raw);
+        out.assign(raw.begin(), raw.end());
+    }
+
+
+    void decode_byte_array(std::string_view bytes, const MsgPackValue &encoding, DecodedData &data) {
+        auto type = static_cast<ByteArrayType>(encoding.at("type").as_int());
+        data.is_float = type == ByteArrayType::Float32 or type == ByteArrayType::Float64;
+
+        switch (type) {
+            case ByteArrayType::Int8:
+                widen<int8_t>(bytes, data.ints);
+                break;
+            case ByteArrayType::Int16:
+                widen<int16_t>(bytes, data.ints);
+                break;
+            case ByteArrayType::Int32:
+                widen<int32_t>(bytes, data.ints);
+                break;
+            case ByteArrayType::Uint8:
+                widen<uint8_t>(bytes, data.ints);
+                break;
+            case ByteArrayType::Uint16:
+                widen<uint16_t>(bytes, data.ints);
+                break;
+            case ByteArrayType::Uint32:
+                widen<uint32_t>(bytes, data.ints);
+                break;
+            case ByteArrayType::Float32: {
+                /* Floats are stored as IEEE 754 bit patterns, reinterpret them through integers of the same size */
+                std::vector<uint32_t> raw;
+                read_little_endian(bytes, raw);
+                data.floats.resize(raw.size());
+                for (size_t i = 0; i < raw.size(); i++) {
+                    data.floats[i] = std::bit_cast<float>(raw[i]);
+                }
+                break;
+            }
+            case ByteArrayType::Float64: {
+                std::vector<uint64_t> raw;
+                read_little_endian(bytes, raw);
+                data.floats.resize(raw.size());
+                for (size_t i = 0; i < raw.size(); i++) {
+                    data.floats[i] = std::bit_cast<double>(raw[i]);
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error(std::format("Unsupported ByteArray type {}", static_cast<int>(type)));
+        }
+    }
+
+
+    void decode_integer_packing(const MsgPackValue &encoding, DecodedData &data) {
+        const auto byte_count = encoding.at("byteCount").as_int();
+        const bool is_unsigned = encoding.at("isUnsigned").boolean;
+        const auto src_size = static_cast<size_t>(encoding.at("srcSize").as_int());
+
+        int64_t upper;
+        int64_t lower;
+        if (byte_count == 1) {
+            upper = is_unsigned ? 0xFF : 0x7F;
+            lower = is_unsigned ? 0 : -0x80;
+        } else if (byte_count == 2) {
+            upper = is_unsigned ? 0xFFFF : 0x7FFF;
+            lower = is_unsigned ? 0 : -0x8000;
+        } else {
+            /* Values were not packed */
+            return;
+        }
+
+        std::vector<int64_t> out;
+        out.reserve(std::min(src_size, data.ints.size()));
+        const auto &packed = data.ints;
+        for (size_t i = 0; i < packed.size(); i++) {
+            int64_t value = 0;
+            int64_t t = packed[i];
+            while (t == upper or (t == lower and lower != 0)) {
+                value += t;
+                i++;
+                if (i >= packed.size()) {
+                    throw std::runtime_error("Invalid IntegerPacking data");
+                }
+                t = packed[i];
+            }
+            out.push_back(value + t);
+        }
+
+        data.ints = std::move(out);
+    }
+
+
+    /* The decoded data must not have more than max_size values; only RunLength expands the data, which could
+     * otherwise allocate arbitrary amounts of memory for a short input */
+    void decode_data(std::string_view bytes, const MsgPackValue &encodings, DecodedData &data, size_t max_size) {
+        /* Encodings are listed in the order in which they were applied */
+        bool raw = true;
+        for (auto it = encodings.array.rbegin(); it != encodings.array.rend(); it++) {
+            const auto &encoding = *it;
+            auto kind = encoding.at("kind").as_string();
+
+            if (raw != (kind == "ByteArray")) {
+                throw std::runtime_error(std::format("Unexpected encoding {}", kind));
+            }
+
+            if (kind == "ByteArray") {
+                decode_byte_array(bytes, encoding, data);
+                raw = false;
+            } else if (kind == "FixedPoint") {
+                const double factor = encoding.at("factor").as_double();
+                data.floats.resize(data.ints.size());
+                for (size_t i = 0; i < data.ints.size(); i++) {
+                    data.floats[i] = static_cast<double>(data.ints[i]) / factor;
+                }
+                data.ints.clear();
+                data.is_float = true;
+            } else if (kind == "IntervalQuantization") {
+                const double min = encoding.at("min").as_double();
+                const double max = encoding.at("max").as_double();
+                const auto steps = encoding.at("numSteps").as_int();
+                if (steps <= 1) {
+                    throw std::runtime_error("Invalid number of steps of IntervalQuantization");
+                }
+                const double delta = (max - min) / static_cast<double>(steps - 1);
+                data.floats.resize(data.ints.size());
+                for (size_t i = 0; i < data.ints.size(); i++) {
+                    data.floats[i] = min + delta * static_cast<double>(data.ints[i]);
+                }
+                data.ints.clear();
+                data.is_float = true;
+            } else if (kind == "RunLength") {
+                size_t total = 0;
+                for (size_t i = 0; i + 1 < data.ints.size(); i += 2) {
+                    const auto count = data.ints[i + 1];
+                    if (count < 0 or static_cast<size_t>(count) > max_size - total) {
+                        throw std::runtime_error("Invalid RunLength data");
+                    }
+                    total += static_cast<size_t>(count);
+                }
+                if (total != static_cast<size_t>(encoding.at("srcSize").as_int())) {
+                    throw std::runtime_error("Invalid RunLength data");
+                }
+
+                std::vector<int64_t> out;
+                out.reserve(total);
+                for (size_t i = 0; i + 1 < data.ints.size(); i += 2) {
+                    out.insert(out.end(), static_cast<size_t>(data.ints[i + 1]), data.ints[i]);
+                }
+                data.ints = std::move(out);
+            } else if (kind == "Delta") {
+                int64_t value = encoding.at("origin").as_int();
+                for (auto &x: data.ints) {
+                    value += x;
+                    x = value;
+                }
+            } else if (kind == "IntegerPacking") {
+                decode_integer_packing(encoding, data);
+            } else {
+                throw std::runtime_error(std::format("Unsupported encoding {}", kind));
+            }
+        }
+
+        if (raw) {
+            throw std::runtime_error("Missing ByteArray encoding");
+        }
+    }
+
+
+    Column decode_column(const MsgPackValue &column, size_t row_count) {
+        Column result;
+
+        const auto &encoded = column.at("data");
+        const auto &encodings = encoded.at("encoding");
+        const auto bytes = encoded.at("data").bytes;
+
+        if (not encodings.array.empty() and encodings.array.front().at("kind").as_string() == "StringArray") {
+            const auto &encoding = encodings.array.front();
+            const auto string_data = encoding.at("stringData").as_string();
+
+            /* Every string but the empty one takes at least a byte */
+            DecodedData offsets;
+            decode_data(encoding.at("offsets").bytes, encoding.at("offsetEncoding"), offsets, string_data.size() + 2);
+
+            DecodedData indices;
+            decode_data(bytes, encoding.at("dataEncoding"), indices, row_count);
+
+            result.is_string = true;
+            result.strings.reserve(indices.ints.size());
+            for (auto idx: indices.ints) {
+                if (idx < 0) {
+                    result.strings.emplace_back();
+                    continue;
+                }
+                auto i = static_cast<size_t>(idx);
+                if (i + 1 >= offsets.ints.size()) {
+                    throw std::runtime_error("Invalid StringArray index");
+                }
+                auto begin = offsets.ints[i];
+                auto end = offsets.ints[i + 1];
+                if (begin < 0 or end < begin or static_cast<size_t>(end) > string_data.size()) {
+                    throw std::runtime_error("Invalid StringArray offsets");
+                }
+                result.strings.push_back(string_data.substr(static_cast<size_t>(begin),
+                                                            static_cast<size_t>(end - begin)));
+            }
+        } else {
+            decode_data(bytes, encodings, result.numbers, row_count);
+        }
+
+        const auto *mask = column.find("mask");
+        if (mask != nullptr and mask->type == MsgPackValue::Type::Map) {
+            DecodedData mask_data;
+            decode_data(mask->at("data").bytes, mask->at("encoding"), mask_data, row_count);
+            result.mask.assign(mask_data.ints.begin(), mask_data.ints.end());
+        }
+
+        const size_t size = result.is_string ? result.strings.size() :
+                            (result.numbers.is_float ? result.numbers.floats.size() : result.numbers.ints.size());
+        if (size != row_count or (not result.mask.empty() and result.mask.size() != row_count)) {
+            throw std::runtime_error(std::format("Invalid number of values in column {}",
+                                                 column.at("name").as_string()));
+        }
+
+        return result;
+    }
+}
+
+
+void BCIF::process_block(const MsgPackValue &block, size_t file_size,
+                         std::unique_ptr<std::vector<Molecule>> &molecules) {
+    const MsgPackValue *atom_site = nullptr;
+    for (const auto &category: block.at("categories").array) {
+        auto category_name = category.at("name").as_string();
+        if (category_name == "_atom_site" or category_name == "atom_site") {
+            atom_site = &category;
+            break;
+        }
+    }
+
+    if (atom_site == nullptr) {
+        throw std::runtime_error("The BinaryCIF file does not have _atom_site category");
+    }
+
+    /* Coordinates of distinct atoms cannot be encoded in less than a byte per atom */
+    const auto rows = atom_site->at("rowCount").as_int();
+    if (rows < 0 or static_cast<uint64_t>(rows) > file_size) {
+        throw std::runtime_error("Invalid number of rows of the _atom_site category");
+    }
+    const auto row_count = static_cast<size_t>(rows);
+
+    /* Decode only the columns we need, author-defined names take precedence as in gemmi */
+    static const std::vector<std::string_view> wanted = {
+        "group_PDB", "type_symbol", "label_atom_id", "auth_atom_id", "label_alt_id", "label_comp_id",
+        "auth_comp_id", "label_asym_id", "auth_asym_id", "label_seq_id", "auth_seq_id", "Cartn_x", "Cartn_y",
+        "Cartn_z", "pdbx_formal_charge", "pdbx_PDB_model_num"
+    };
+
+    std::map<std::string_view, Column> columns;
+    for (const auto &column: atom_site->at("columns").array) {
+        auto column_name = column.at("name").as_string();
+        if (std::ranges::find(wanted, column_name) != wanted.end()) {
+            columns.emplace(column_name, decode_column(column, row_count));
+        }
+    }
+
+    auto get = [&columns](std::string_view preferred, std::string_view fallback = {}) -> const Column * {
+        if (auto it = columns.find(preferred); it != columns.end()) {
+            return &it->second;
+        }
+        if (auto it = columns.find(fallback); not fallback.empty() and it != columns.end()) {
+            return &it->second;
+        }
+        return nullptr;
+    };
+
+    const auto *x = get("Cartn_x");
+    const auto *y = get("Cartn_y");
+    const auto *z = get("Cartn_z");
+    const auto *type_symbol = get("type_symbol");
+    const auto *atom_name = get("auth_atom_id", "label_atom_id");
+    const auto *residue_name = get("auth_comp_id", "label_comp_id");
+    const auto *chain = get("auth_asym_id", "label_asym_id");
+    const auto *residue_id = get("auth_seq_id", "label_seq_id");
+
+    if (not x or not y or not z or not type_symbol or not atom_name or not residue_name or not chain or
+        not residue_id) {
+        throw std::runtime_error("The _atom_site category is missing mandatory columns");
+    }
+
+    const auto *group = get("group_PDB");
+    const auto *alt_id = get("label_alt_id");
+    const auto *formal_charge = get("pdbx_formal_charge");
+    const auto *model = get("pdbx_PDB_model_num");
+
+    auto atoms = std::make_unique<std::vector<Atom>>();
+    atoms->reserve(row_count);
+
+    size_t idx = 0;
+    for (size_t i = 0; i < row_count; i++) {
+        /* Read the first model only */
+        if (model != nullptr and model->integer(i) != model->integer(0)) {
+            continue;
+        }
+
+        auto alt = alt_id != nullptr ? alt_id->string(i) : std::string_view{};
+        bool hetatm = group != nullptr and group->string(i) == "HETATM";
+        std::string residue(residue_name->string(i));
+
+        if (not keep_atom(alt.empty() ? '\0' : alt.front(), hetatm, residue)) {
+            continue;
+        }
+
+        auto element = PeriodicTable::pte().get_element_by_symbol(
+            get_element_symbol(std::string(type_symbol->string(i))));
+
+        atoms->emplace_back(idx, element, x->number(i), y->number(i), z->number(i), std::string(atom_name->string(i)),
+                            static_cast<int>(residue_id->integer(i)), residue, std::string(chain->string(i)), hetatm);
+        if (formal_charge != nullptr) {
+            atoms->back()._set_formal_charge(static_cast<int>(formal_charge->integer(i)));
+        }
+        idx++;
+    }
+
+    if (atoms->empty()) {
+        throw std::runtime_error("No atoms were loaded");
+    }
+
+    auto bonds = get_bonds(atoms);
+    molecules->emplace_back(std::string(block.at("header").as_string()), std::move(atoms), std::move(bonds));
+}
+
+
+MoleculeSet BCIF::read_file(const std::string &filename) {
+    InputBuffer file(filename);
+
+    auto molecules = std::make_unique<std::vector<Molecule>>();
+    try {
+        auto root = decode_msgpack(file.view());
+        const auto &blocks = root.at("dataBlocks");
+        if (blocks.array.empty()) {
+            throw std::runtime_error("Empty record");
+        }
+        for (const auto &block: blocks.array) {
+            process_block(block, file.view().size(), molecules);
+        }
+    }
+    catch (std::exception &e) {
+        throw FileException(std::format("Cannot load structure: {}", e.what()));
+    }
+
+    return MoleculeSet(std::move(molecules));
+}
+
+BCIF::BCIF() = default;
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "reader.h"
+#include "msgpack.h"
+
+
+class BCIF final: public Reader {
+    /* Blocks of a file of file_size bytes, which bounds the number of their rows */
+    static void process_block(const MsgPackValue &block, size_t file_size,
+                              std::unique_ptr<std::vector<Molecule>> &molecules);
+
+public:
+    BCIF();
+
+    MoleculeSet read_file(const std::string &filename) override;
+};
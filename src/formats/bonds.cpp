@@ -7,6 +7,11 @@
 #include <filesystem>
 #include <map>
 #include <sstream>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <cmath>
 
 #include "bonds.h"
 #include "common.h"
@@ -25,6 +30,18 @@ void load_residues_info(const std::string &filename,
 void update_bonds(std::unique_ptr<std::vector<Bond>> &bonds, const std::map<std::string, const Atom *> &residue_atoms);
 
 
+std::vector<std::pair<size_t, size_t>> perceive_chain_bonds(const std::vector<Atom> &atoms,
+                                                            const std::vector<size_t> &chain_atoms,
+                                                            const std::vector<bool> &covered);
+
+
+/* Maximal excess over the sum of covalent radii that is still considered a bond (in Å) */
+constexpr double BOND_TOLERANCE = 0.4;
+
+/* Closer atoms are considered an overlap (e.g., unresolved alternative locations), not a bond */
+constexpr double MIN_BOND_DISTANCE = 0.4;
+
+
 void load_residues_info(const std::string &filename,
                         std::map<std::string, std::vector<std::tuple<std::string, std::string, int>>> &residues_data) {
     std::ifstream file(filename);
@@ -60,26 +77,30 @@ void update_bonds(std::unique_ptr<std::vector<Bond>> &bonds, const std::map<std:
         return;
     }
 
-    static std::map<std::string, std::vector<std::tuple<std::string, std::string, int>>> residues_data;
-    static bool basic_loaded = false;
-    static bool all_loaded = false;
-
-    if (not basic_loaded) {
-        load_residues_info(InstallPaths::datadir()/ "amino_acids.txt", residues_data);
-        basic_loaded = true;
-    }
+    /* Function-local statics are initialized exactly once even when files are read concurrently; the much larger
+     * set of other residues is only loaded if some residue is not an amino acid */
+    using residues_map = std::map<std::string, std::vector<std::tuple<std::string, std::string, int>>>;
+    static const residues_map amino_acids = [] {
+        residues_map data;
+        load_residues_info(InstallPaths::datadir() / "amino_acids.txt", data);
+        return data;
+    }();
 
     auto residue = residue_atoms.begin()->second->residue();
-    auto it = residues_data.find(residue);
-
-    /* Try to load additional residues */
-    if (not all_loaded and it == residues_data.end()) {
-        load_residues_info(InstallPaths::datadir() / "other_residues.txt", residues_data);
-        all_loaded = true;
-        it = residues_data.find(residue);
+    auto it = amino_acids.find(residue);
+    auto end = amino_acids.end();
+
+    if (it == end) {
+        static const residues_map other_residues = [] {
+            residues_map data;
+            load_residues_info(InstallPaths::datadir() / "other_residues.txt", data);
+            return data;
+        }();
+        it = other_residues.find(residue);
+        end = other_residues.end();
     }
 
-    if (it != residues_data.end()) {
+    if (it != end) {
         for (const auto &[atom1_name, atom2_name, order]: it->second) {
             auto it1 = residue_atoms.find(atom1_name);
             auto it2 = residue_atoms.find(atom2_name);
@@ -92,6 +113,78 @@ void update_bonds(std::unique_ptr<std::vector<Bond>> &bonds, const std::map<std:
 }
 
 
+std::vector<std::pair<size_t, size_t>> perceive_chain_bonds(const std::vector<Atom> &atoms,
+                                                            const std::vector<size_t> &chain_atoms,
+                                                            const std::vector<bool> &covered) {
+
+    std::vector<std::pair<size_t, size_t>> pairs;
+
+    double max_radius = 0;
+    for (auto idx: chain_atoms) {
+        max_radius = std::max(max_radius, atoms[idx].element().covalent_radius());
+    }
+
+    /* Any two bonded atoms lie in the same or in the adjacent cells */
+    const double cell_size = 2 * max_radius + BOND_TOLERANCE;
+
+    using Cell = std::array<int, 3>;
+    auto cell_of = [cell_size](const Atom &atom) {
+        const auto &pos = atom.pos();
+        return Cell{static_cast<int>(std::floor(pos[0] / cell_size)),
+                    static_cast<int>(std::floor(pos[1] / cell_size)),
+                    static_cast<int>(std::floor(pos[2] / cell_size))};
+    };
+
+    auto cell_hash = [](const Cell &cell) {
+        return static_cast<size_t>(cell[0]) * 73856093u ^ static_cast<size_t>(cell[1]) * 19349663u ^
+               static_cast<size_t>(cell[2]) * 83492791u;
+    };
+
+    std::unordered_map<Cell, std::vector<size_t>, decltype(cell_hash)> grid(chain_atoms.size(), cell_hash);
+    for (auto idx: chain_atoms) {
+        grid[cell_of(atoms[idx])].push_back(idx);
+    }
+
+    for (auto i: chain_atoms) {
+        if (covered[i]) {
+            continue;
+        }
+
+        const auto &atom_i = atoms[i];
+        const auto cell = cell_of(atom_i);
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    auto it = grid.find({cell[0] + dx, cell[1] + dy, cell[2] + dz});
+                    if (it == grid.end()) {
+                        continue;
+                    }
+                    for (auto j: it->second) {
+                        /* Pairs of two uncovered atoms are visited twice, keep only one */
+                        if (j == i or (not covered[j] and j < i)) {
+                            continue;
+                        }
+
+                        const auto &atom_j = atoms[j];
+                        const double max_distance = atom_i.element().covalent_radius() +
+                                                    atom_j.element().covalent_radius() + BOND_TOLERANCE;
+                        double d2 = 0;
+                        for (int k = 0; k < 3; k++) {
+                            d2 += (atom_i.pos()[k] - atom_j.pos()[k]) * (atom_i.pos()[k] - atom_j.pos()[k]);
+                        }
+                        if (d2 > MIN_BOND_DISTANCE * MIN_BOND_DISTANCE and d2 <= max_distance * max_distance) {
+                            pairs.emplace_back(std::min(i, j), std::max(i, j));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return pairs;
+}
+
+
 std::unique_ptr<std::vector<Bond>> get_bonds(std::unique_ptr<std::vector<Atom>> &atoms) {
 
     auto bonds = std::make_unique<std::vector<Bond>>();
@@ -147,5 +240,49 @@ std::unique_ptr<std::vector<Bond>> get_bonds(std::unique_ptr<std::vector<Atom>>
         }
     }
 
+    /* Atoms not bonded by any template (ligands, modified and unknown residues) get bonds based on distances */
+    const size_t n = atoms->size();
+    std::vector<bool> covered(n, false);
+    std::set<std::pair<size_t, size_t>> existing;
+    for (const auto &bond: *bonds) {
+        size_t i = &bond.first() - atoms->data();
+        size_t j = &bond.second() - atoms->data();
+        covered[i] = true;
+        covered[j] = true;
+        existing.emplace(std::min(i, j), std::max(i, j));
+    }
+
+    std::vector<std::vector<size_t>> chains;
+    std::map<std::string, size_t> chain_index;
+    bool any_uncovered = false;
+    for (size_t i = 0; i < n; i++) {
+        auto [it, inserted] = chain_index.try_emplace((*atoms)[i].chain_id(), chains.size());
+        if (inserted) {
+            chains.emplace_back();
+        }
+        chains[it->second].push_back(i);
+        any_uncovered |= not covered[i];
+    }
+
+    if (not any_uncovered) {
+        return bonds;
+    }
+
+    std::vector<std::vector<std::pair<size_t, size_t>>> perceived(chains.size());
+    const auto &atoms_ref = *atoms;
+
+    #pragma omp parallel for schedule(dynamic) default(none) shared(atoms_ref, chains, covered, perceived)
+    for (size_t c = 0; c < chains.size(); c++) {
+        perceived[c] = perceive_chain_bonds(atoms_ref, chains[c], covered);
+    }
+
+    for (const auto &pairs: perceived) {
+        for (const auto &[i, j]: pairs) {
+            if (not existing.contains({i, j})) {
+                bonds->emplace_back(&(*atoms)[i], &(*atoms)[j], 1);
+            }
+        }
+    }
+
     return bonds;
 }
@@ -2,8 +2,11 @@
 #include <vector>
 #include <format>
 #include <stdexcept>
-#include <fstream>
+#include <ostream>
 #include <filesystem>
+#include <sstream>
+#include <map>
+#include <exception>
 
 #include <gemmi/align.hpp>
 #include <gemmi/cif.hpp>
@@ -17,8 +20,13 @@
 #include "../config.h"
 #include "../utility/strings.h"
 #include "../utility/exceptions.h"
+#include "../utility/compression.h"
 
 
+static std::string output_compression_extension() {
+    return compression_extension(compression_from_name(config::output_compression));
+}
+
 static std::string convert_bond_order_to_mmcif_value_order_string(int order) {
     // See link for bond order values for PDBx/mmCIF category _chem_comp_bond.value_order
     // https://mmcif.wwpdb.org/dictionaries/mmcif_pdbx_v50.dic/Items/_chem_comp_bond.value_order.html#papwtenum
@@ -118,33 +126,112 @@ static void filter_out_altloc_atoms(gemmi::cif::Block &block) {
     gemmi::update_mmcif_block(structure, block);
 }
 
-static void generate_mmcif_from_block(gemmi::cif::Block &block, const MoleculeSet &ms, const Charges &charges) {
-    const Molecule &molecule = ms.molecules()[0];
-
+static void prepare_mmcif_block(gemmi::cif::Block &block, const Molecule &molecule, const Charges &charges) {
     filter_out_altloc_atoms(block);
     append_audit_conform(block);
     append_charges_to_block(molecule, charges, block);
-    
-    const std::filesystem::path out_dir{config::chg_out_dir};
-    const std::string molecule_name = to_lowercase(molecule.name());
-    const std::string out_filename = molecule_name + ".fw2.cif";
-    std::ofstream out_stream{out_dir / out_filename};
 
     // remove pesky _chem_comp category >:(
     block.find_mmcif_category("_chem_comp.").erase();
+}
 
-    gemmi::cif::write_cif_block_to_stream(out_stream, block);
+static std::string block_to_string(const gemmi::cif::Block &block) {
+    std::ostringstream out;
+    gemmi::cif::write_cif_block_to_stream(out, block);
+    return out.str();
 }
 
-static void generate_mmcif_from_cif_file(const MoleculeSet &ms, const Charges &charges, const std::string &filename) {
-    auto document = gemmi::cif::read_file(filename);
-    auto& block = document.sole_block();
-    
-    generate_mmcif_from_block(block, ms, charges);
+/* Write serialized blocks into one file per molecule or, if requested, into a single file; empty blocks are skipped */
+static void write_mmcif_blocks(const MoleculeSet &ms, const std::vector<std::string> &blocks, const std::string &filename) {
+    const std::filesystem::path out_dir{config::chg_out_dir};
+
+    if (config::merge_cif_output) {
+        const auto stem = std::filesystem::path(strip_compression_extension(filename)).filename().string();
+        write_chunks((out_dir / (stem + ".fw2.cif" + output_compression_extension())).string(), blocks);
+        return;
+    }
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].empty()) {
+            continue;
+        }
+        const std::string molecule_name = to_lowercase(ms.molecules()[i].name());
+        const std::string out_filename = molecule_name + ".fw2.cif" + output_compression_extension();
+        write_chunks((out_dir / out_filename).string(), std::vector<std::string_view>{blocks[i]});
+    }
 }
 
-static void generate_mmcif_from_pdb_file(const MoleculeSet &ms, const Charges &charges, const std::string &filename) {
-    auto structure = gemmi::read_pdb_file(filename);
+/* Build the blocks in parallel; molecules without charges get an empty block */
+template<typename Builder>
+static std::vector<std::string> build_mmcif_blocks(size_t count, const Builder &builder) {
+    std::vector<std::string> blocks(count);
+    std::vector<std::exception_ptr> errors(count);
+
+    #pragma omp parallel for schedule(dynamic) default(none) shared(blocks, errors, builder) firstprivate(count)
+    for (size_t i = 0; i < count; i++) {
+        try {
+            blocks[i] = builder(i);
+        } catch (std::out_of_range &) {
+            /* Do nothing */
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    }
+
+    for (const auto &error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    return blocks;
+}
+
+static void generate_mmcif_from_cif_file(const MoleculeSet &ms, const Charges &charges, const std::string &filename,
+                                         const std::string &output_name) {
+    gemmi::cif::Document document;
+    if (compression_from_filename(filename) == Compression::NONE) {
+        document = gemmi::cif::read_file(filename);
+    } else {
+        InputBuffer buffer(filename);
+        document = gemmi::cif::read_string(std::string(buffer.view()));
+    }
+
+    /* Every data block of the input was loaded as a separate molecule named after the block */
+    std::map<std::string, gemmi::cif::Block *> blocks_by_name;
+    for (auto &block: document.blocks) {
+        blocks_by_name.emplace(block.name, &block);
+    }
+
+    const auto &molecules = ms.molecules();
+    std::vector<gemmi::cif::Block *> molecule_blocks(molecules.size(), nullptr);
+    for (size_t i = 0; i < molecules.size(); i++) {
+        auto node = blocks_by_name.extract(molecules[i].name());
+        if (not node.empty()) {
+            molecule_blocks[i] = node.mapped();
+        }
+    }
+
+    auto blocks = build_mmcif_blocks(molecules.size(), [&](size_t i) -> std::string {
+        if (molecule_blocks[i] == nullptr) {
+            return {};
+        }
+        prepare_mmcif_block(*molecule_blocks[i], molecules[i], charges);
+        return block_to_string(*molecule_blocks[i]);
+    });
+
+    write_mmcif_blocks(ms, blocks, output_name);
+}
+
+static void generate_mmcif_from_pdb_file(const MoleculeSet &ms, const Charges &charges, const std::string &filename,
+                                         const std::string &output_name) {
+    gemmi::Structure structure;
+    if (compression_from_filename(filename) == Compression::NONE) {
+        structure = gemmi::read_pdb_file(filename);
+    } else {
+        InputBuffer buffer(filename);
+        structure = gemmi::read_pdb_from_memory(buffer.view().data(), buffer.view().size(), filename);
+    }
 
     if (structure.models.empty() || structure.models[0].chains.empty()) {
         throw FileException("No models or no chains in PDB file.");
@@ -155,10 +242,12 @@ static void generate_mmcif_from_pdb_file(const MoleculeSet &ms, const Charges &c
 
     auto block = gemmi::make_mmcif_block(structure);
 
-    generate_mmcif_from_block(block, ms, charges);
+    prepare_mmcif_block(block, ms.molecules()[0], charges);
+    write_mmcif_blocks(ms, {block_to_string(block)}, output_name);
 }
 
-static void generate_mmcif_from_atom_and_bond_data(const MoleculeSet &ms, const Charges &charges) {
+static void generate_mmcif_from_atom_and_bond_data(const MoleculeSet &ms, const Charges &charges,
+                                                   const std::string &output_name) {
     const std::string atom_site_prefix = "_atom_site.";
     const std::string chem_comp_prefix = "_chem_comp.";    
     const std::string chem_comp_bond_prefix = "_chem_comp_bond.";
@@ -190,12 +279,9 @@ static void generate_mmcif_from_atom_and_bond_data(const MoleculeSet &ms, const
     };
 
 
-    for (const auto& molecule : ms.molecules()) {
-        std::filesystem::path out_dir{config::chg_out_dir};
-        std::string molecule_name = to_lowercase(molecule.name());    
-        std::string out_filename = molecule_name + ".fw2.cif";
-        std::string out_file{(out_dir / out_filename).string()};
-        std::ofstream out_stream{out_file};
+    auto blocks = build_mmcif_blocks(ms.molecules().size(), [&](size_t i) -> std::string {
+        const auto &molecule = ms.molecules()[i];
+        const std::string molecule_name = to_lowercase(molecule.name());
 
         auto document = gemmi::cif::Document{};
         auto& block = document.add_new_block(molecule_name);
@@ -255,20 +341,22 @@ static void generate_mmcif_from_atom_and_bond_data(const MoleculeSet &ms, const
         append_audit_conform(block);
         append_charges_to_block(molecule, charges, block);
 
-        gemmi::cif::write_cif_block_to_stream(out_stream, block);
-    }
+        return block_to_string(block);
+    });
+
+    write_mmcif_blocks(ms, blocks, output_name);
 }
 
 void CIF::save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) {
-    auto ext = std::filesystem::path(filename).extension().string();
-    
+    auto ext = std::filesystem::path(strip_compression_extension(filename)).extension().string();
+
     try {    
         if (ext == ".cif") {
-            generate_mmcif_from_cif_file(ms, charges, config::input_file);
+            generate_mmcif_from_cif_file(ms, charges, input_file_, filename);
         } else if (ext == ".pdb" or ext == ".ent") {
-            generate_mmcif_from_pdb_file(ms, charges, config::input_file);
-        } else if (ext == ".mol2" or ext == ".sdf") {
-            generate_mmcif_from_atom_and_bond_data(ms, charges);
+            generate_mmcif_from_pdb_file(ms, charges, input_file_, filename);
+        } else if (ext == ".mol2" or ext == ".sdf" or ext == ".bcif" or ext == ".fw2bin") {
+            generate_mmcif_from_atom_and_bond_data(ms, charges, filename);
         }
     } catch (std::out_of_range &) {
         /* Do nothing */
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <utility>
 #include <gemmi/cif.hpp>
 
 #include "writer.h"
@@ -9,6 +10,10 @@
 
 
 class CIF final: public Writer {
+    /* mmCIF and PDB inputs are re-read so that the output keeps all of their data */
+    std::string input_file_;
 public:
+    explicit CIF(std::string input_file) : input_file_{std::move(input_file)} {}
+
     void save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) override;
 };
@@ -50,12 +50,16 @@ std::string fix_atom_name(std::string &atom_name) {
 }
 
 
-bool keep_atom(const gemmi::Atom& atom, const gemmi::Residue& residue) {
-    if (not atom.has_altloc() or atom.altloc == 'A') {
-        const bool hetatm = residue.het_flag == 'H';
-        if (not hetatm or (config::read_hetatm and (residue.name != "HOH" or not config::ignore_water))) {
+bool keep_atom(char altloc, bool hetatm, const std::string &residue_name) {
+    if (altloc == '\0' or altloc == 'A') {
+        if (not hetatm or (config::read_hetatm and (residue_name != "HOH" or not config::ignore_water))) {
             return true;
         }
     }
     return false;
 }
+
+
+bool keep_atom(const gemmi::Atom& atom, const gemmi::Residue& residue) {
+    return keep_atom(atom.has_altloc() ? atom.altloc : '\0', residue.het_flag == 'H', residue.name);
+}
@@ -13,4 +13,6 @@ std::string get_element_symbol(const std::string &substring);
 
 std::string fix_atom_name(std::string &atom_name);
 
+bool keep_atom(char altloc, bool hetatm, const std::string &residue_name);
+
 bool keep_atom(const gemmi::Atom &atom, const gemmi::Residue &residue);
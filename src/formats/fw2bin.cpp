@@ -0,0 +1,387 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "fw2bin.h"
+#include "../config.h"
+#include "../periodic_table.h"
+#include "../structures/atom.h"
+#include "../structures/bond.h"
+#include "../structures/molecule.h"
+#include "../utility/compression.h"
+#include "../utility/exceptions.h"
+
+
+/*
+ * File layout (native endianness, every section aligned to 8 bytes):
+ *   Header
+ *   uint64_t string offsets[n_strings + 1]
+ *   char string data[string_data_size]
+ *   MoleculeRecord[n_molecules]
+ *   AtomRecord[n_atoms]
+ *   BondRecord[n_bonds]
+ * Strings (names, residues, chains, Mol2 types) are interned and referred to by their index.
+ */
+
+namespace {
+    constexpr char MAGIC[8] = {'F', 'W', '2', 'B', 'I', 'N', '\0', '\0'};
+    constexpr uint32_t VERSION = 2;
+    constexpr uint32_t ENDIANNESS_CHECK = 0x01020304;
+
+    enum Flags : uint32_t {
+        READ_HETATM = 1u << 0,
+        IGNORE_WATER = 1u << 1
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t endianness;
+        uint32_t flags;
+        uint32_t reserved;
+        uint64_t n_molecules;
+        uint64_t n_atoms;
+        uint64_t n_bonds;
+        uint64_t n_strings;
+        uint64_t string_data_size;
+        /* Input file the cache was created from, all zero if none */
+        uint64_t input_path_hash;
+        uint64_t input_size;
+        int64_t input_mtime;
+        uint64_t reserved2;
+    };
+
+    struct InputIdentity {
+        uint64_t path_hash;
+        uint64_t size;
+        int64_t mtime;
+
+        bool operator==(const InputIdentity &) const = default;
+    };
+
+    struct MoleculeRecord {
+        uint64_t name;
+        uint64_t first_atom;
+        uint64_t n_atoms;
+        uint64_t first_bond;
+        uint64_t n_bonds;
+    };
+
+    struct AtomRecord {
+        double x;
+        double y;
+        double z;
+        uint32_t name;
+        uint32_t residue;
+        uint32_t chain_id;
+        uint32_t atom_type_mol2;
+        int32_t residue_id;
+        int32_t formal_charge;
+        uint16_t Z;
+        uint8_t hetatm;
+        uint8_t padding[5];
+    };
+
+    struct BondRecord {
+        uint32_t first;
+        uint32_t second;
+        int32_t order;
+        uint32_t padding;
+    };
+
+    uint32_t current_flags() {
+        return (config::read_hetatm ? READ_HETATM : 0u) | (config::ignore_water ? IGNORE_WATER : 0u);
+    }
+
+    size_t align(size_t offset) {
+        return (offset + 7) & ~static_cast<size_t>(7);
+    }
+
+    /* Canonical path (FNV-1a), size and modification time of the file */
+    InputIdentity input_identity(const std::string &filename) {
+        namespace fs = std::filesystem;
+
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const char c: fs::canonical(filename).string()) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+        }
+        return {hash, static_cast<uint64_t>(fs::file_size(filename)),
+                static_cast<int64_t>(fs::last_write_time(filename).time_since_epoch().count())};
+    }
+
+
+    class StringTable {
+        std::unordered_map<std::string, uint32_t> ids_;
+        std::vector<uint64_t> offsets_{0};
+        std::string data_;
+
+    public:
+        uint32_t intern(const std::string &str) {
+            auto [it, inserted] = ids_.try_emplace(str, static_cast<uint32_t>(offsets_.size() - 1));
+            if (inserted) {
+                data_ += str;
+                offsets_.push_back(data_.size());
+            }
+            return it->second;
+        }
+
+        [[nodiscard]] const std::vector<uint64_t> &offsets() const { return offsets_; }
+
+        [[nodiscard]] const std::string &data() const { return data_; }
+    };
+
+
+    class SectionReader {
+        std::string_view data_;
+
+    public:
+        explicit SectionReader(std::string_view data) : data_{data} {}
+
+        template<typename T>
+        [[nodiscard]] T get(size_t offset, size_t idx = 0) const {
+            const size_t pos = offset + idx * sizeof(T);
+            if (pos + sizeof(T) > data_.size()) {
+                throw std::runtime_error("Truncated file");
+            }
+            T value;
+            std::memcpy(&value, data_.data() + pos, sizeof(T));
+            return value;
+        }
+
+        [[nodiscard]] std::string_view bytes(size_t offset, size_t size) const {
+            if (offset + size > data_.size()) {
+                throw std::runtime_error("Truncated file");
+            }
+            return data_.substr(offset, size);
+        }
+    };
+
+
+    Header read_header(const SectionReader &reader) {
+        auto header = reader.get<Header>(0);
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+            throw std::runtime_error("Not a fw2bin file");
+        }
+        if (header.endianness != ENDIANNESS_CHECK) {
+            throw std::runtime_error("File was created on a machine with different endianness");
+        }
+        if (header.version != VERSION) {
+            throw std::runtime_error(std::format("Unsupported fw2bin version {}", header.version));
+        }
+        return header;
+    }
+}
+
+
+MoleculeSet FW2Bin::read_file(const std::string &filename) {
+    InputBuffer buffer(filename);
+    SectionReader reader(buffer.view());
+
+    auto molecules = std::make_unique<std::vector<Molecule>>();
+    try {
+        const auto header = read_header(reader);
+
+        const size_t offsets_start = align(sizeof(Header));
+        const size_t strings_start = align(offsets_start + (header.n_strings + 1) * sizeof(uint64_t));
+        const size_t molecules_start = align(strings_start + header.string_data_size);
+        const size_t atoms_start = align(molecules_start + header.n_molecules * sizeof(MoleculeRecord));
+        const size_t bonds_start = align(atoms_start + header.n_atoms * sizeof(AtomRecord));
+
+        /* Validate the size up front so that the parallel part cannot run out of the buffer */
+        reader.bytes(bonds_start, header.n_bonds * sizeof(BondRecord));
+
+        const auto string_data = reader.bytes(strings_start, header.string_data_size);
+        auto get_string = [&](uint64_t idx) -> std::string {
+            if (idx >= header.n_strings) {
+                throw std::runtime_error("Invalid string reference");
+            }
+            auto begin = reader.get<uint64_t>(offsets_start, idx);
+            auto end = reader.get<uint64_t>(offsets_start, idx + 1);
+            if (begin > end or end > string_data.size()) {
+                throw std::runtime_error("Invalid string table");
+            }
+            return std::string(string_data.substr(begin, end - begin));
+        };
+
+        const auto n = static_cast<size_t>(header.n_molecules);
+        molecules->resize(n);
+        std::vector<std::string> errors(n);
+
+#pragma omp parallel for schedule(dynamic) default(none) shared(reader, header, molecules, errors, get_string) firstprivate(n, molecules_start, atoms_start, bonds_start)
+        for (size_t i = 0; i < n; i++) {
+            try {
+                const auto record = reader.get<MoleculeRecord>(molecules_start, i);
+                if (record.first_atom + record.n_atoms > header.n_atoms or
+                    record.first_bond + record.n_bonds > header.n_bonds) {
+                    throw std::runtime_error("Invalid molecule record");
+                }
+
+                auto atoms = std::make_unique<std::vector<Atom>>();
+                atoms->reserve(record.n_atoms);
+                for (size_t j = 0; j < record.n_atoms; j++) {
+                    const auto a = reader.get<AtomRecord>(atoms_start, record.first_atom + j);
+                    if (a.Z == 0 or a.Z > PeriodicTable::pte().size()) {
+                        throw std::runtime_error("Invalid element");
+                    }
+                    const auto element = PeriodicTable::pte().get_element_by_Z(a.Z - 1);
+                    atoms->emplace_back(j, element, a.x, a.y, a.z, get_string(a.name), a.residue_id,
+                                        get_string(a.residue), get_string(a.chain_id), a.hetatm != 0);
+                    atoms->back()._set_formal_charge(a.formal_charge);
+                    atoms->back()._set_atom_type_mol2(get_string(a.atom_type_mol2));
+                }
+
+                auto bonds = std::make_unique<std::vector<Bond>>();
+                bonds->reserve(record.n_bonds);
+                for (size_t j = 0; j < record.n_bonds; j++) {
+                    const auto b = reader.get<BondRecord>(bonds_start, record.first_bond + j);
+                    if (b.first >= record.n_atoms or b.second >= record.n_atoms) {
+                        throw std::runtime_error("Bond refers to a non-existent atom");
+                    }
+                    bonds->emplace_back(&(*atoms)[b.first], &(*atoms)[b.second], b.order);
+                }
+
+                (*molecules)[i] = Molecule(get_string(record.name), std::move(atoms), std::move(bonds));
+            } catch (std::exception &e) {
+                errors[i] = e.what();
+            }
+        }
+
+        for (const auto &error: errors) {
+            if (not error.empty()) {
+                throw std::runtime_error(error);
+            }
+        }
+    }
+    catch (std::exception &e) {
+        throw FileException(std::format("Cannot load {}: {}", filename, e.what()));
+    }
+
+    return MoleculeSet(std::move(molecules));
+}
+
+
+void FW2Bin::write_file(const MoleculeSet &ms, const std::string &filename, const std::string &input_file) {
+    StringTable strings;
+    std::vector<MoleculeRecord> molecule_records;
+    std::vector<AtomRecord> atom_records;
+    std::vector<BondRecord> bond_records;
+
+    molecule_records.reserve(ms.molecules().size());
+    for (const auto &molecule: ms.molecules()) {
+        molecule_records.push_back({
+            .name = strings.intern(molecule.name()),
+            .first_atom = atom_records.size(),
+            .n_atoms = molecule.atoms().size(),
+            .first_bond = bond_records.size(),
+            .n_bonds = molecule.bonds().size()
+        });
+
+        for (const auto &atom: molecule.atoms()) {
+            atom_records.push_back({
+                .x = atom.pos()[0],
+                .y = atom.pos()[1],
+                .z = atom.pos()[2],
+                .name = strings.intern(atom.name()),
+                .residue = strings.intern(atom.residue()),
+                .chain_id = strings.intern(atom.chain_id()),
+                .atom_type_mol2 = strings.intern(atom.atom_type_mol2()),
+                .residue_id = atom.residue_id(),
+                .formal_charge = atom.formal_charge(),
+                .Z = static_cast<uint16_t>(atom.element().Z()),
+                .hetatm = static_cast<uint8_t>(atom.hetatm()),
+                .padding = {}
+            });
+        }
+
+        for (const auto &bond: molecule.bonds()) {
+            bond_records.push_back({
+                .first = static_cast<uint32_t>(bond.first().index()),
+                .second = static_cast<uint32_t>(bond.second().index()),
+                .order = bond.order(),
+                .padding = 0
+            });
+        }
+    }
+
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.endianness = ENDIANNESS_CHECK;
+    header.flags = current_flags();
+    header.n_molecules = molecule_records.size();
+    header.n_atoms = atom_records.size();
+    header.n_bonds = bond_records.size();
+    header.n_strings = strings.offsets().size() - 1;
+    header.string_data_size = strings.data().size();
+    if (not input_file.empty()) {
+        const auto identity = input_identity(input_file);
+        header.input_path_hash = identity.path_hash;
+        header.input_size = identity.size;
+        header.input_mtime = identity.mtime;
+    }
+
+    /* Write to a temporary file first so that an interrupted run does not leave a broken cache behind */
+    const std::string tmp_filename = filename + ".tmp";
+    {
+        std::ofstream out(tmp_filename, std::ios::binary);
+        if (!out) {
+            throw FileException(std::format("Cannot open file: {}", tmp_filename));
+        }
+
+        size_t written = 0;
+        auto write = [&out, &written](const void *data, size_t size) {
+            out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+            written += size;
+            static constexpr char zeros[8] = {};
+            const size_t padding = align(written) - written;
+            out.write(zeros, static_cast<std::streamsize>(padding));
+            written += padding;
+        };
+
+        write(&header, sizeof(header));
+        write(strings.offsets().data(), strings.offsets().size() * sizeof(uint64_t));
+        write(strings.data().data(), strings.data().size());
+        write(molecule_records.data(), molecule_records.size() * sizeof(MoleculeRecord));
+        write(atom_records.data(), atom_records.size() * sizeof(AtomRecord));
+        write(bond_records.data(), bond_records.size() * sizeof(BondRecord));
+
+        if (!out) {
+            throw FileException(std::format("Cannot write file: {}", tmp_filename));
+        }
+    }
+
+    std::filesystem::rename(tmp_filename, filename);
+}
+
+
+MoleculeSet load_molecule_set_cached(const std::string &filename, const std::string &cache_file) {
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    if (fs::exists(cache_file, ec)) {
+        try {
+            InputBuffer buffer(cache_file);
+            auto header = read_header(SectionReader(buffer.view()));
+            const InputIdentity cached{header.input_path_hash, header.input_size, header.input_mtime};
+            if (header.flags == current_flags() and cached == input_identity(filename)) {
+                return FW2Bin().read_file(cache_file);
+            }
+        } catch (std::exception &) {
+            /* Stale or broken cache, regenerate it below */
+        }
+    }
+
+    auto ms = load_molecule_set(filename);
+    FW2Bin::write_file(ms, cache_file, filename);
+    return ms;
+}
+
+FW2Bin::FW2Bin() = default;
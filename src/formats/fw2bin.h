@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "reader.h"
+
+
+/* Native binary dump of a loaded MoleculeSet, see fw2bin.cpp for the layout */
+class FW2Bin final: public Reader {
+public:
+    FW2Bin();
+
+    MoleculeSet read_file(const std::string &filename) override;
+
+    /* The identity of input_file (path, size and modification time) is recorded for load_molecule_set_cached */
+    static void write_file(const MoleculeSet &ms, const std::string &filename, const std::string &input_file = "");
+};
+
+
+/* Load molecules from cache_file if it was created from the same filename (and its size and modification time did not
+ * change since), otherwise load filename and store the cache */
+MoleculeSet load_molecule_set_cached(const std::string &filename, const std::string &cache_file);
@@ -1,6 +1,7 @@
 #include <string>
 #include <stdexcept>
-#include <fstream>
+#include <istream>
+#include <algorithm>
 #include <format>
 #include <gemmi/read_cif.hpp>
 #include <gemmi/mmcif.hpp>
@@ -11,6 +12,7 @@
 #include "../structures/bond.h"
 #include "../periodic_table.h"
 #include "../utility/exceptions.h"
+#include "../utility/compression.h"
 
 
 void mmCIF::read_protein_molecule(gemmi::cif::Block &data, std::unique_ptr<std::vector<Atom>> &atoms) {
@@ -74,11 +76,8 @@ MoleculeSet mmCIF::read_file(const std::string &filename) {
 
     auto molecules = std::make_unique<std::vector<Molecule>>();
     try {
-        std::ifstream file(filename);
-        if (!file) {
-            throw FileException(std::format("Cannot open file: {}", filename));
-        }
-        while(std::getline(file, line)) {
+        auto file = open_input_stream(filename);
+        while(std::getline(*file, line)) {
             if (line.starts_with("#") or line.empty()) {
                 continue;
             }
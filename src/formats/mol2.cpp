@@ -1,11 +1,12 @@
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <optional>
+#include <algorithm>
 #include <format>
 #include <print>
-#include <fstream>
-#include <sstream>
-#include <iterator>
+#include <ostream>
 #include <stdexcept>
 #include <set>
 
@@ -15,68 +16,137 @@
 #include "../periodic_table.h"
 #include "mol2.h"
 #include "../utility/exceptions.h"
+#include "../utility/compression.h"
+#include "../utility/tokenizer.h"
+#include "../utility/text_buffer.h"
+
+
+std::vector<std::string_view> Mol2::split_records(std::string_view data) {
+    constexpr std::string_view marker = "@<TRIPOS>MOLECULE";
+
+    /* Each record starts right after the @<TRIPOS>MOLECULE line, comments or empty lines before the first one are skipped */
+    std::vector<std::string_view> records;
+    size_t record_start = std::string_view::npos;
+    size_t pos = 0;
+    std::string_view line;
+    while (true) {
+        size_t line_start = pos;
+        if (not next_line(data, pos, line)) {
+            break;
+        }
+        if (line == marker) {
+            if (record_start != std::string_view::npos) {
+                records.push_back(data.substr(record_start, line_start - record_start));
+            }
+            record_start = std::min(pos, data.size());
+        }
+    }
+
+    if (record_start != std::string_view::npos and record_start < data.size()) {
+        records.push_back(data.substr(record_start));
+    }
 
+    return records;
+}
 
-void Mol2::read_record(std::ifstream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
+
+void Mol2::read_record(std::string_view record, std::unique_ptr<std::vector<Atom>> &atoms,
                        std::unique_ptr<std::vector<Bond>> &bonds) {
+    size_t pos = 0;
+    std::string_view line;
+    std::string_view token;
 
-    std::getline(file, line);
+    if (not next_line(record, pos, line)) {
+        throw std::runtime_error("Missing atom and bond counts");
+    }
 
-    std::stringstream ss(line);
-    size_t n_atoms, n_bonds;
-    ss >> n_atoms >> n_bonds;
+    size_t n_atoms = 0;
+    size_t n_bonds = 0;
+    size_t lpos = 0;
+    if (not next_token(line, lpos, token) or not parse_number(token, n_atoms)) {
+        throw std::runtime_error("Invalid atom count");
+    }
+    if (next_token(line, lpos, token) and not parse_number(token, n_bonds)) {
+        throw std::runtime_error("Invalid bond count");
+    }
 
     /* Skip the rest until atom records */
-    do {
-        std::getline(file, line);
-    } while (line != "@<TRIPOS>ATOM" and not file.eof());
+    bool found = false;
+    while (next_line(record, pos, line)) {
+        if (line == "@<TRIPOS>ATOM") {
+            found = true;
+            break;
+        }
+    }
+
+    if (not found) {
+        throw std::runtime_error("No ATOM record");
+    }
 
     atoms->reserve(n_atoms);
     for (size_t i = 0; i < n_atoms; i++) {
-        std::getline(file, line);
-        std::stringstream as(line);
-        size_t idx;
-        std::string atom_name, atom_type;
-        double x, y, z;
-
-        size_t residue_id = 0;
-        std::string residue = "UNL";
-        as >> idx >> atom_name >> x >> y >> z >> atom_type;
-        as >> residue_id >> residue;
-
-        std::string element_symbol;
-        auto it = atom_type.find('.');
-        if (it != std::string::npos) {
-            element_symbol = atom_type.substr(0, it);
-        } else {
-            element_symbol = atom_type;
+        if (not next_line(record, pos, line)) {
+            throw std::runtime_error("Unexpected end of ATOM record");
+        }
+
+        std::string_view atom_name;
+        std::string_view atom_type;
+        std::string_view residue = "UNL";
+        double x = 0, y = 0, z = 0;
+        int residue_id = 0;
+
+        lpos = 0;
+        bool ok = next_token(line, lpos, token) and
+                  next_token(line, lpos, atom_name) and
+                  next_token(line, lpos, token) and parse_number(token, x) and
+                  next_token(line, lpos, token) and parse_number(token, y) and
+                  next_token(line, lpos, token) and parse_number(token, z) and
+                  next_token(line, lpos, atom_type);
+        if (not ok) {
+            throw std::runtime_error("Invalid ATOM record");
+        }
+
+        if (next_token(line, lpos, token) and parse_number(token, residue_id)) {
+            next_token(line, lpos, residue);
         }
 
+        auto element_symbol = atom_type.substr(0, atom_type.find('.'));
         auto element = PeriodicTable::pte().get_element_by_symbol(element_symbol);
 
-        atoms->emplace_back(i, element, x, y, z, atom_name, residue_id, residue, "", false);
-        atoms->back()._set_atom_type_mol2(atom_type);
+        atoms->emplace_back(i, element, x, y, z, std::string(atom_name), residue_id, std::string(residue), "", false);
+        atoms->back()._set_atom_type_mol2(std::string(atom_type));
     }
 
     /* Read @<TRIPOS>BOND */
-    std::getline(file, line);
-    if (line != "@<TRIPOS>BOND") {
+    if (not next_line(record, pos, line) or line != "@<TRIPOS>BOND") {
         throw std::runtime_error("No BOND record");
     }
 
     bonds->reserve(n_bonds);
     for (size_t i = 0; i < n_bonds; i++) {
-        std::getline(file, line);
-        std::stringstream bs(line);
+        if (not next_line(record, pos, line)) {
+            throw std::runtime_error("Unexpected end of BOND record");
+        }
 
-        size_t idx, first, second;
-        std::string type;
-        bs >> idx >> first >> second >> type;
+        size_t first = 0;
+        size_t second = 0;
+        std::string_view type;
+
+        lpos = 0;
+        bool ok = next_token(line, lpos, token) and
+                  next_token(line, lpos, token) and parse_number(token, first) and
+                  next_token(line, lpos, token) and parse_number(token, second) and
+                  next_token(line, lpos, type);
+        if (not ok) {
+            throw std::runtime_error("Invalid BOND record");
+        }
+
+        if (first == 0 or second == 0 or first > n_atoms or second > n_atoms) {
+            throw std::runtime_error("Bond refers to a non-existent atom");
+        }
 
         int order;
-        try {
-            order = std::stoi(type);
-        } catch (std::invalid_argument &) {
+        if (not parse_number(type, order)) {
             /* Set bond order to 1 for aromatic and other bond types */
             order = 1;
         }
@@ -85,104 +155,129 @@ void Mol2::read_record(std::ifstream &file, std::string &line, std::unique_ptr<s
 }
 
 
-void Mol2::read_until_end_of_record(std::ifstream &file) {
-    std::string line;
-    while (std::getline(file, line)) {
-        if (line == "@<TRIPOS>MOLECULE") {
-            break;
-        }
-    }
-}
-
-
 MoleculeSet Mol2::read_file(const std::string &filename) {
-    std::ifstream file(filename);
-    if (!file) {
-        throw FileException(std::format("Cannot open file: {}", filename));
-    }
+    InputBuffer file(filename);
 
-    auto molecules = std::make_unique<std::vector<Molecule>>();
+    auto records = split_records(file.view());
+    const size_t n = records.size();
 
-    std::string line;
-    std::string name;
+    /* Names have to be made unique in the file order, so resolve them first */
     std::set<std::string> molecule_names;
+    std::vector<std::string> names(n);
+    std::vector<std::string_view> bodies(n);
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = 0;
+        std::string_view line;
+        next_line(records[i], pos, line);
+
+        auto name = sanitize_name(std::string(line));
+        name = get_unique_name(name, molecule_names);
+        molecule_names.insert(name);
+
+        names[i] = std::move(name);
+        bodies[i] = records[i].substr(std::min(pos, records[i].size()));
+    }
 
-    /* Skip comments or empty lines*/
-    do {
-        std::getline(file, line);
-    } while (line != "@<TRIPOS>MOLECULE" and not file.eof());
+    std::vector<std::optional<Molecule>> parsed(n);
+    std::vector<std::string> errors(n);
 
-    while (std::getline(file, line)) {
+#pragma omp parallel for schedule(dynamic) default(none) shared(names, bodies, parsed, errors) firstprivate(n)
+    for (size_t i = 0; i < n; i++) {
         try {
-            name = sanitize_name(line);
-            name = get_unique_name(name, molecule_names);
-            molecule_names.insert(name);
-
             auto atoms = std::make_unique<std::vector<Atom>>();
             auto bonds = std::make_unique<std::vector<Bond>>();
-            read_record(file, line, atoms, bonds);
+            read_record(bodies[i], atoms, bonds);
 
             if (atoms->empty()) {
                 throw std::runtime_error("No atoms were loaded");
             }
 
-            molecules->emplace_back(name, std::move(atoms), std::move(bonds));
+            parsed[i].emplace(names[i], std::move(atoms), std::move(bonds));
         }
         catch (std::exception &e) {
-            std::println(stderr, "Error when reading {}: {}", name, e.what());
+            errors[i] = e.what();
+        }
+    }
+
+    auto molecules = std::make_unique<std::vector<Molecule>>();
+    molecules->reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (parsed[i].has_value()) {
+            molecules->emplace_back(std::move(parsed[i].value()));
+        } else {
+            std::println(stderr, "Error when reading {}: {}", names[i], errors[i]);
         }
-        read_until_end_of_record(file);
     }
 
     return MoleculeSet(std::move(molecules));
 }
 
 
-void Mol2::save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) {
-    auto file = std::fopen(filename.c_str(), "w");
-    if (!file) {
-        throw FileException(std::format("Cannot open file: {}", filename));
+std::string Mol2::charges_comment(const std::string &method_name) {
+    return "Charges calculated by ChargeFW2 " + std::string(VERSION) + ", method: " + method_name;
+}
+
+
+void Mol2::append_molecule(TextBuffer &buffer, const Molecule &molecule, const std::vector<double> &charges,
+                           const std::string &comment) {
+    buffer.reserve(buffer.size() + 80 * (molecule.atoms().size() + molecule.bonds().size()) + 256);
+
+    buffer.append("@<TRIPOS>MOLECULE\n").append(molecule.name()).append('\n');
+    buffer.append_int(static_cast<long long>(molecule.atoms().size())).append(' ')
+          .append_int(static_cast<long long>(molecule.bonds().size())).append('\n');
+
+    /* Try to guess if the molecule is protein or not */
+    if (molecule.atoms()[0].chain_id().empty()) {
+        buffer.append("SMALL\n");
+    } else {
+        buffer.append("PROTEIN\n");
+    }
+    buffer.append("USER_CHARGES\n****\n");
+    buffer.append(comment).append('\n');
+
+    buffer.append("@<TRIPOS>ATOM\n");
+    for (size_t i = 0; i < molecule.atoms().size(); i++) {
+        const auto &atom = molecule.atoms()[i];
+        std::string atom_type = atom.atom_type_mol2();
+        if (atom_type.empty()) {
+            atom_type = atom.element().symbol();
+        }
+        buffer.append_int(static_cast<long long>(i + 1), 5).append(' ').append_left(atom.name(), 6).append(' ')
+              .append_fixed(atom.pos()[0], 3, 8).append(' ').append_fixed(atom.pos()[1], 3, 8).append(' ')
+              .append_fixed(atom.pos()[2], 3, 8).append(' ').append_left(atom_type, 5).append(' ')
+              .append_int(atom.residue_id(), 3).append(' ').append_right(atom.residue(), 3).append(' ')
+              .append_fixed(charges[i], 3, 6).append('\n');
     }
 
-    for (const auto &molecule: ms.molecules()) {
-        try {
-            auto chg = charges[molecule.name()];
-            std::println(file, "@<TRIPOS>MOLECULE");
-            std::println(file, "{}", molecule.name());
-            std::println(file, "{} {}", molecule.atoms().size(), molecule.bonds().size());
-
-            /* Try to guess if the molecule is protein or not */
-            if (molecule.atoms()[0].chain_id().empty()) {
-                std::println(file, "SMALL");
-            } else {
-                std::println(file, "PROTEIN");
-            }
-            std::println(file, "USER_CHARGES");
-            std::println(file, "****");
-            std::println(file, "Charges calculated by ChargeFW2 {}, method: {}", VERSION, charges.method_name());
-
-            std::println(file, "@<TRIPOS>ATOM");
-            for (size_t i = 0; i < molecule.atoms().size(); i++) {
-                const auto &atom = molecule.atoms()[i];
-                std::string atom_type = atom.atom_type_mol2();
-                if (atom_type.empty()) {
-                    atom_type = atom.element().symbol();
-                }
-                std::println(file, "{:>5d} {:<6s} {:>8.3f} {:>8.3f} {:>8.3f} {:<5s} {:>3d} {:>3s} {:>6.3f}",
-                           i + 1, atom.name(), atom.pos()[0], atom.pos()[1], atom.pos()[2], atom_type,
-                           atom.residue_id(), atom.residue(), chg[i]);
-            }
+    buffer.append("@<TRIPOS>BOND\n");
+    for (size_t i = 0; i < molecule.bonds().size(); i++) {
+        const auto &bond = molecule.bonds()[i];
+        buffer.append_int(static_cast<long long>(i + 1), 5).append(' ')
+              .append_int(static_cast<long long>(bond.first().index() + 1), 5).append(' ')
+              .append_int(static_cast<long long>(bond.second().index() + 1), 5).append(' ')
+              .append_int(bond.order(), 2).append('\n');
+    }
+}
 
-            std::println(file, "@<TRIPOS>BOND");
-            for (size_t i = 0; i < molecule.bonds().size(); i++) {
-                const auto &bond = molecule.bonds()[i];
-                std::println(file, "{:>5d} {:>5d} {:>5d} {:>2d}",
-                           i + 1, bond.first().index() + 1, bond.second().index() + 1, bond.order());
-            }
+
+void Mol2::save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) {
+    const auto &molecules = ms.molecules();
+    std::vector<std::string> chunks(molecules.size());
+    const std::string comment = charges_comment(charges.method_name());
+
+    /* Every molecule is formatted into its own buffer, the buffers are written in the original order */
+    #pragma omp parallel for schedule(dynamic) default(none) shared(molecules, charges, chunks, comment)
+    for (size_t m = 0; m < molecules.size(); m++) {
+        const auto &molecule = molecules[m];
+        try {
+            TextBuffer buffer;
+            append_molecule(buffer, molecule, charges.values(molecule.name()), comment);
+            chunks[m] = buffer.release();
         }
         catch (std::out_of_range &) {
             /* Do nothing */
         }
     }
-    fclose(file);
+
+    write_chunks(filename, chunks);
 }
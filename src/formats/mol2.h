@@ -1,18 +1,28 @@
 #pragma once
 
+#include <string_view>
+#include <vector>
+
 #include "reader.h"
 #include "writer.h"
 #include "../charges.h"
+#include "../utility/text_buffer.h"
 
 
 class Mol2 final : public Reader, public Writer {
-    static void read_until_end_of_record(std::ifstream &file);
+    static std::vector<std::string_view> split_records(std::string_view data);
 
-    static void read_record(std::ifstream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
-                     std::unique_ptr<std::vector<Bond>> &bonds);
+    static void read_record(std::string_view record, std::unique_ptr<std::vector<Atom>> &atoms,
+                            std::unique_ptr<std::vector<Bond>> &bonds);
 
 public:
     MoleculeSet read_file(const std::string &filename) override;
 
+    /* Comment line stored in the header of every molecule */
+    static std::string charges_comment(const std::string &method_name);
+
+    static void append_molecule(TextBuffer &buffer, const Molecule &molecule, const std::vector<double> &charges,
+                                const std::string &comment);
+
     void save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) override;
 };
@@ -0,0 +1,221 @@
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string_view>
+
+#include "msgpack.h"
+
+
+namespace {
+    class MsgPackParser {
+        std::string_view data_;
+        size_t pos_{0};
+
+        void require(size_t count) const {
+            if (pos_ + count > data_.size()) {
+                throw std::runtime_error("Unexpected end of MessagePack data");
+            }
+        }
+
+        template<typename T>
+        T read_be() {
+            require(sizeof(T));
+            T value;
+            std::memcpy(&value, data_.data() + pos_, sizeof(T));
+            pos_ += sizeof(T);
+            if constexpr (std::endian::native == std::endian::little and sizeof(T) > 1) {
+                value = std::byteswap(value);
+            }
+            return value;
+        }
+
+        std::string_view read_bytes(size_t count) {
+            require(count);
+            auto view = data_.substr(pos_, count);
+            pos_ += count;
+            return view;
+        }
+
+        /* Counts come from the data, so they are checked against the rest of it (an element takes at least a byte)
+         * before anything is allocated */
+        MsgPackValue make_array(size_t count) {
+            require(count);
+            MsgPackValue value;
+            value.type = MsgPackValue::Type::Array;
+            value.array.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                value.array.push_back(parse());
+            }
+            return value;
+        }
+
+        MsgPackValue make_map(size_t count) {
+            require(2 * count);
+            MsgPackValue value;
+            value.type = MsgPackValue::Type::Map;
+            value.map.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                auto key = parse();
+                if (key.type != MsgPackValue::Type::String) {
+                    throw std::runtime_error("Only string keys are supported in MessagePack maps");
+                }
+                value.map.emplace_back(key.bytes, parse());
+            }
+            return value;
+        }
+
+        static MsgPackValue make_int(int64_t integer) {
+            MsgPackValue value;
+            value.type = MsgPackValue::Type::Int;
+            value.integer = integer;
+            return value;
+        }
+
+        static MsgPackValue make_float(double number) {
+            MsgPackValue value;
+            value.type = MsgPackValue::Type::Float;
+            value.number = number;
+            return value;
+        }
+
+        static MsgPackValue make_bytes(MsgPackValue::Type type, std::string_view bytes) {
+            MsgPackValue value;
+            value.type = type;
+            value.bytes = bytes;
+            return value;
+        }
+
+    public:
+        explicit MsgPackParser(std::string_view data) : data_{data} {}
+
+        MsgPackValue parse() {
+            auto tag = read_be<uint8_t>();
+
+            if (tag <= 0x7f) {
+                return make_int(tag);
+            }
+            if (tag >= 0xe0) {
+                return make_int(static_cast<int8_t>(tag));
+            }
+            if ((tag & 0xf0) == 0x80) {
+                return make_map(tag & 0x0f);
+            }
+            if ((tag & 0xf0) == 0x90) {
+                return make_array(tag & 0x0f);
+            }
+            if ((tag & 0xe0) == 0xa0) {
+                return make_bytes(MsgPackValue::Type::String, read_bytes(tag & 0x1f));
+            }
+
+            switch (tag) {
+                case 0xc0:
+                    return {};
+                case 0xc2:
+                case 0xc3: {
+                    MsgPackValue value;
+                    value.type = MsgPackValue::Type::Bool;
+                    value.boolean = tag == 0xc3;
+                    return value;
+                }
+                case 0xc4:
+                    return make_bytes(MsgPackValue::Type::Binary, read_bytes(read_be<uint8_t>()));
+                case 0xc5:
+                    return make_bytes(MsgPackValue::Type::Binary, read_bytes(read_be<uint16_t>()));
+                case 0xc6:
+                    return make_bytes(MsgPackValue::Type::Binary, read_bytes(read_be<uint32_t>()));
+                case 0xca:
+                    return make_float(std::bit_cast<float>(read_be<uint32_t>()));
+                case 0xcb:
+                    return make_float(std::bit_cast<double>(read_be<uint64_t>()));
+                case 0xcc:
+                    return make_int(read_be<uint8_t>());
+                case 0xcd:
+                    return make_int(read_be<uint16_t>());
+                case 0xce:
+                    return make_int(read_be<uint32_t>());
+                case 0xcf:
+                    return make_int(static_cast<int64_t>(read_be<uint64_t>()));
+                case 0xd0:
+                    return make_int(static_cast<int8_t>(read_be<uint8_t>()));
+                case 0xd1:
+                    return make_int(static_cast<int16_t>(read_be<uint16_t>()));
+                case 0xd2:
+                    return make_int(static_cast<int32_t>(read_be<uint32_t>()));
+                case 0xd3:
+                    return make_int(static_cast<int64_t>(read_be<uint64_t>()));
+                case 0xd9:
+                    return make_bytes(MsgPackValue::Type::String, read_bytes(read_be<uint8_t>()));
+                case 0xda:
+                    return make_bytes(MsgPackValue::Type::String, read_bytes(read_be<uint16_t>()));
+                case 0xdb:
+                    return make_bytes(MsgPackValue::Type::String, read_bytes(read_be<uint32_t>()));
+                case 0xdc:
+                    return make_array(read_be<uint16_t>());
+                case 0xdd:
+                    return make_array(read_be<uint32_t>());
+                case 0xde:
+                    return make_map(read_be<uint16_t>());
+                case 0xdf:
+                    return make_map(read_be<uint32_t>());
+                default:
+                    throw std::runtime_error(std::format("Unsupported MessagePack type 0x{:02x}", tag));
+            }
+        }
+    };
+}
+
+
+const MsgPackValue *MsgPackValue::find(std::string_view key) const {
+    for (const auto &[k, v]: map) {
+        if (k == key) {
+            return &v;
+        }
+    }
+    return nullptr;
+}
+
+
+const MsgPackValue &MsgPackValue::at(std::string_view key) const {
+    auto value = find(key);
+    if (value == nullptr) {
+        throw std::runtime_error(std::format("Missing key \"{}\" in MessagePack map", key));
+    }
+    return *value;
+}
+
+
+int64_t MsgPackValue::as_int() const {
+    if (type == Type::Int) {
+        return integer;
+    }
+    if (type == Type::Float) {
+        return static_cast<int64_t>(number);
+    }
+    throw std::runtime_error("MessagePack value is not a number");
+}
+
+
+double MsgPackValue::as_double() const {
+    if (type == Type::Float) {
+        return number;
+    }
+    if (type == Type::Int) {
+        return static_cast<double>(integer);
+    }
+    throw std::runtime_error("MessagePack value is not a number");
+}
+
+
+std::string_view MsgPackValue::as_string() const {
+    if (type != Type::String) {
+        throw std::runtime_error("MessagePack value is not a string");
+    }
+    return bytes;
+}
+
+
+MsgPackValue decode_msgpack(std::string_view data) {
+    return MsgPackParser(data).parse();
+}
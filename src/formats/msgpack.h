@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+/* Minimal MessagePack document model; strings and binary blobs point into the decoded buffer */
+class MsgPackValue {
+public:
+    enum class Type {
+        Nil,
+        Bool,
+        Int,
+        Float,
+        String,
+        Binary,
+        Array,
+        Map
+    };
+
+    Type type{Type::Nil};
+    bool boolean{};
+    int64_t integer{};
+    double number{};
+    std::string_view bytes{};
+    std::vector<MsgPackValue> array{};
+    std::vector<std::pair<std::string_view, MsgPackValue>> map{};
+
+    [[nodiscard]] const MsgPackValue *find(std::string_view key) const;
+
+    [[nodiscard]] const MsgPackValue &at(std::string_view key) const;
+
+    [[nodiscard]] int64_t as_int() const;
+
+    [[nodiscard]] double as_double() const;
+
+    [[nodiscard]] std::string_view as_string() const;
+};
+
+
+MsgPackValue decode_msgpack(std::string_view data);
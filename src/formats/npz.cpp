@@ -0,0 +1,278 @@
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+
+#include "npz.h"
+#include "../charges.h"
+#include "../utility/compression.h"
+#include "../utility/exceptions.h"
+
+
+namespace {
+
+/* DOS date of 1980-01-01, the earliest representable one */
+constexpr uint16_t ZIP_DATE = (1 << 5) | 1;
+
+constexpr uint16_t ZIP_VERSION = 20;
+
+/* Array data start at a multiple of this in the npy files as well as in the archive, so they can be memory-mapped */
+constexpr size_t ALIGNMENT = 64;
+
+/* Extra field used by zipalign for padding local headers */
+constexpr uint16_t ZIP_PADDING_ID = 0xd935;
+
+
+void put_u16(std::string &out, uint16_t value) {
+    out.push_back(static_cast<char>(value & 0xff));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+
+void put_u32(std::string &out, uint32_t value) {
+    put_u16(out, static_cast<uint16_t>(value & 0xffff));
+    put_u16(out, static_cast<uint16_t>(value >> 16));
+}
+
+
+char byte_order() {
+    return std::endian::native == std::endian::little ? '<' : '>';
+}
+
+
+/* Header of an .npy file (format version 1.0) describing a one-dimensional array */
+std::string npy_header(const std::string &descr, size_t length) {
+    std::string dict = std::format("{{'descr': '{}', 'fortran_order': False, 'shape': ({},), }}", descr, length);
+
+    /* Magic, version and header length take 10 bytes, the data should start at a multiple of 64 */
+    constexpr size_t PREAMBLE = 10;
+    size_t total = (PREAMBLE + dict.size() + 1 + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    dict.append(total - PREAMBLE - dict.size() - 1, ' ');
+    dict.push_back('\n');
+
+    std::string header("\x93NUMPY\x01\x00", 8);
+    put_u16(header, static_cast<uint16_t>(dict.size()));
+    return header + dict;
+}
+
+
+/* Decode UTF-8 into code points; invalid bytes are kept as their values */
+std::u32string decode_utf8(std::string_view text) {
+    std::u32string result;
+    for (size_t i = 0; i < text.size();) {
+        auto c = static_cast<unsigned char>(text[i]);
+        size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xe ? 3 : (c >> 3) == 0x1e ? 4 : 0;
+        if (length <= 1 or i + length > text.size()) {
+            result.push_back(c);
+            i++;
+            continue;
+        }
+
+        char32_t cp = c & (0x7f >> length);
+        bool valid = true;
+        for (size_t j = 1; j < length; j++) {
+            auto cont = static_cast<unsigned char>(text[i + j]);
+            valid &= (cont >> 6) == 0x2;
+            cp = (cp << 6) | (cont & 0x3f);
+        }
+
+        if (valid) {
+            result.push_back(cp);
+            i += length;
+        } else {
+            result.push_back(c);
+            i++;
+        }
+    }
+    return result;
+}
+
+
+/* Fixed-width unicode array (dtype <U) of the molecule names */
+std::string names_array(const std::vector<std::string> &names) {
+    std::vector<std::u32string> decoded;
+    size_t width = 1;
+    for (const auto &name: names) {
+        decoded.push_back(decode_utf8(name));
+        width = std::max(width, decoded.back().size());
+    }
+
+    std::string data;
+    data.reserve(names.size() * width * 4);
+    for (const auto &name: decoded) {
+        for (size_t i = 0; i < width; i++) {
+            uint32_t cp = i < name.size() ? static_cast<uint32_t>(name[i]) : 0;
+            if constexpr (std::endian::native == std::endian::little) {
+                put_u32(data, cp);
+            } else {
+                put_u32(data, std::byteswap(cp));
+            }
+        }
+    }
+
+    return npy_header(std::format("{}U{}", byte_order(), width), names.size()) + data;
+}
+
+
+void put_u64(std::string &out, uint64_t value) {
+    put_u32(out, static_cast<uint32_t>(value & 0xffffffff));
+    put_u32(out, static_cast<uint32_t>(value >> 32));
+}
+
+
+struct ZipEntry {
+    std::string name;
+    uint32_t crc;
+    uint32_t size;
+    uint64_t offset;
+};
+
+
+/* Central directory and its end record; ZIP64 records are used only when the classic fields overflow */
+std::string zip_directory(const std::vector<ZipEntry> &entries, uint64_t directory_offset) {
+    constexpr uint32_t MAX_U32 = std::numeric_limits<uint32_t>::max();
+    constexpr uint16_t MAX_U16 = std::numeric_limits<uint16_t>::max();
+    constexpr uint16_t ZIP64_VERSION = 45;
+
+    std::string out;
+    for (const auto &entry: entries) {
+        bool zip64 = entry.offset >= MAX_U32;
+        put_u32(out, 0x02014b50);
+        put_u16(out, zip64 ? ZIP64_VERSION : ZIP_VERSION);
+        put_u16(out, zip64 ? ZIP64_VERSION : ZIP_VERSION);
+        put_u16(out, 0);
+        put_u16(out, 0);
+        put_u16(out, 0);
+        put_u16(out, ZIP_DATE);
+        put_u32(out, entry.crc);
+        put_u32(out, entry.size);
+        put_u32(out, entry.size);
+        put_u16(out, static_cast<uint16_t>(entry.name.size()));
+        put_u16(out, zip64 ? 12 : 0);
+        put_u16(out, 0);
+        put_u16(out, 0);
+        put_u16(out, 0);
+        put_u32(out, 0);
+        put_u32(out, zip64 ? MAX_U32 : static_cast<uint32_t>(entry.offset));
+        out += entry.name;
+        if (zip64) {
+            put_u16(out, 0x0001);
+            put_u16(out, 8);
+            put_u64(out, entry.offset);
+        }
+    }
+
+    uint64_t directory_size = out.size();
+    bool zip64 = entries.size() >= MAX_U16 or directory_size >= MAX_U32 or directory_offset >= MAX_U32;
+    if (zip64) {
+        uint64_t record_offset = directory_offset + directory_size;
+        put_u32(out, 0x06064b50);
+        put_u64(out, 44);
+        put_u16(out, ZIP64_VERSION);
+        put_u16(out, ZIP64_VERSION);
+        put_u32(out, 0);
+        put_u32(out, 0);
+        put_u64(out, entries.size());
+        put_u64(out, entries.size());
+        put_u64(out, directory_size);
+        put_u64(out, directory_offset);
+
+        put_u32(out, 0x07064b50);
+        put_u32(out, 0);
+        put_u64(out, record_offset);
+        put_u32(out, 1);
+    }
+
+    put_u32(out, 0x06054b50);
+    put_u16(out, 0);
+    put_u16(out, 0);
+    put_u16(out, zip64 ? MAX_U16 : static_cast<uint16_t>(entries.size()));
+    put_u16(out, zip64 ? MAX_U16 : static_cast<uint16_t>(entries.size()));
+    put_u32(out, zip64 ? MAX_U32 : static_cast<uint32_t>(directory_size));
+    put_u32(out, zip64 ? MAX_U32 : static_cast<uint32_t>(directory_offset));
+    put_u16(out, 0);
+
+    return out;
+}
+
+}
+
+
+void NPZ::save_charges(const MoleculeSet &, const Charges &charges, const std::string &filename) {
+    const auto names = charges.names();
+
+    /* Headers are owned here (deque keeps them in place), the charge data are written directly from Charges */
+    std::deque<std::string> headers;
+    std::vector<std::string_view> chunks;
+    std::vector<ZipEntry> entries;
+    uint64_t offset = 0;
+
+    auto add_entry = [&](const std::string &entry_name, std::string npy_head, std::string_view data) {
+        if (npy_head.size() + data.size() >= std::numeric_limits<uint32_t>::max()) {
+            throw FileException(std::format("Array {} too large for an npz file: {}", entry_name, filename));
+        }
+
+        uint32_t crc = crc32(0L, Z_NULL, 0);
+        crc = crc32_z(crc, reinterpret_cast<const Bytef *>(npy_head.data()), npy_head.size());
+        if (not data.empty()) {
+            crc = crc32_z(crc, reinterpret_cast<const Bytef *>(data.data()), data.size());
+        }
+        auto size = static_cast<uint32_t>(npy_head.size() + data.size());
+
+        /* The extra field pads the local header so that the npy file (whose header is a multiple of ALIGNMENT long)
+         * starts aligned; a padding field needs at least four bytes for its id and size */
+        constexpr size_t LOCAL_HEADER_SIZE = 30;
+        const size_t unaligned = (offset + LOCAL_HEADER_SIZE + entry_name.size()) % ALIGNMENT;
+        size_t padding = unaligned == 0 ? 0 : ALIGNMENT - unaligned;
+        if (padding != 0 and padding < 4) {
+            padding += ALIGNMENT;
+        }
+
+        /* Offsets beyond 4 GiB are stored only in the central directory */
+        std::string local;
+        put_u32(local, 0x04034b50);
+        put_u16(local, ZIP_VERSION);
+        put_u16(local, 0);
+        put_u16(local, 0);
+        put_u16(local, 0);
+        put_u16(local, ZIP_DATE);
+        put_u32(local, crc);
+        put_u32(local, size);
+        put_u32(local, size);
+        put_u16(local, static_cast<uint16_t>(entry_name.size()));
+        put_u16(local, static_cast<uint16_t>(padding));
+        local += entry_name;
+        if (padding != 0) {
+            put_u16(local, ZIP_PADDING_ID);
+            put_u16(local, static_cast<uint16_t>(padding - 4));
+            local.append(padding - 4, '\0');
+        }
+
+        entries.push_back({entry_name, crc, size, offset});
+        offset += local.size() + size;
+
+        chunks.emplace_back(headers.emplace_back(std::move(local)));
+        chunks.emplace_back(headers.emplace_back(std::move(npy_head)));
+        if (not data.empty()) {
+            chunks.push_back(data);
+        }
+    };
+
+    add_entry("names.npy", names_array(names), {});
+
+    for (size_t i = 0; i < names.size(); i++) {
+        const auto &values = charges.values(names[i]);
+        add_entry(std::format("mol_{}.npy", i), npy_header(std::format("{}f8", byte_order()), values.size()),
+                  {reinterpret_cast<const char *>(values.data()), values.size() * sizeof(double)});
+    }
+
+    chunks.emplace_back(headers.emplace_back(zip_directory(entries, offset)));
+
+    write_chunks(filename, chunks);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+#include "writer.h"
+#include "../charges.h"
+
+
+/* NumPy archive with a "names" array and one float64 array "mol_<i>" per molecule, stored uncompressed with the array
+ * data at file offsets aligned to 64 bytes */
+class NPZ final: public Writer {
+public:
+    void save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) override;
+};
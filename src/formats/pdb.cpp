@@ -9,12 +9,18 @@
 #include "bonds.h"
 #include "../periodic_table.h"
 #include "../utility/exceptions.h"
+#include "../utility/compression.h"
 
 
 MoleculeSet PDB::read_file(const std::string &filename) {
     gemmi::Structure structure;
     try {
-        structure = gemmi::read_pdb_file(filename);
+        if (compression_from_filename(filename) == Compression::NONE) {
+            structure = gemmi::read_pdb_file(filename);
+        } else {
+            InputBuffer buffer(filename);
+            structure = gemmi::read_pdb_from_memory(buffer.view().data(), buffer.view().size(), filename);
+        }
     }
     catch (std::exception &e) {
         throw FileException(std::format("Cannot load structure: {}", e.what()));
@@ -1,41 +1,91 @@
 #include <string>
-#include <format>
-#include <print>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
 
 #include "pqr.h"
 #include "../structures/molecule_set.h"
 #include "../charges.h"
-#include "../utility/exceptions.h"
+#include "../utility/compression.h"
+#include "../utility/text_buffer.h"
 
 
-void PQR::save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) {
-    auto file = std::fopen(filename.c_str(), "w");
-    if (!file) {
-        throw FileException(std::format("Cannot open file: {}", filename));
+/* Number of atoms formatted by a single thread */
+constexpr size_t PQR_CHUNK_SIZE = 16384;
+
+
+void PQR::append_atoms(TextBuffer &buffer, const Molecule &molecule, const std::vector<double> &charges,
+                       size_t begin, size_t end, size_t model) {
+    const auto &atoms = molecule.atoms();
+    buffer.reserve(buffer.size() + 80 * (end - begin) + 32);
+
+    if (model and begin == 0) {
+        buffer.append("MODEL     ").append_int(static_cast<long long>(model), 4).append('\n');
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        const auto &atom = atoms[i];
+
+        /* Match PDB format weirdness */
+        std::string name;
+        if (atom.element().symbol().length() == 1 and atom.name().length() < 4) {
+            name = " ";
+        }
+        name.append(atom.name());
+
+        buffer.append_left(atom.hetatm() ? "HETATM" : "ATOM", 6).append_int(static_cast<long long>(i + 1), 5)
+              .append(' ').append_left(name, 4).append(' ').append_right(atom.residue(), 3).append(' ')
+              .append_left(atom.chain_id(), 1).append(' ').append_int(atom.residue_id(), 3).append("    ")
+              .append_fixed(atom.pos()[0], 3, 8).append_fixed(atom.pos()[1], 3, 8)
+              .append_fixed(atom.pos()[2], 3, 8).append(' ').append_fixed(charges[i], 3, 6).append(' ')
+              .append_fixed(atom.element().vdw_radius(), 3, 6).append('\n');
+    }
+
+    if (model and end == atoms.size()) {
+        buffer.append("ENDMDL\n");
     }
+}
+
+
+void PQR::save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) {
+    const auto &molecules = ms.molecules();
 
-    const auto &molecule = ms.molecules()[0];
+    /* Molecules of multi-record inputs are stored as separate models */
+    const bool multiple_models = molecules.size() > 1;
 
-    try {
-        auto chg = charges[molecule.name()];
-        for (size_t i = 0; i < molecule.atoms().size(); i++) {
-            const auto &atom = molecule.atoms()[i];
+    struct Task {
+        size_t molecule;
+        size_t begin;
+        size_t end;
+    };
 
-            /* Match PDB format weirdness */
-            std::string name;
-            if (atom.element().symbol().length() == 1 and atom.name().length() < 4) {
-                name = " ";
-            }
-            name.append(atom.name());
+    std::vector<std::vector<double>> chg(molecules.size());
+    std::vector<Task> tasks;
+    for (size_t m = 0; m < molecules.size(); m++) {
+        try {
+            chg[m] = charges[molecules[m].name()];
+        }
+        catch (std::out_of_range &) {
+            /* Do nothing */
+            continue;
+        }
 
-            std::println(file, "{:<6}{:>5d} {:<4s} {:>3s} {:1s} {:>3d}    {:>8.3f}{:>8.3f}{:>8.3f} {:>6.3f} {:>6.3f}",
-                       atom.hetatm() ? "HETATM": "ATOM", i + 1, name, atom.residue(), atom.chain_id(), atom.residue_id(),
-                       atom.pos()[0], atom.pos()[1], atom.pos()[2], chg[i], atom.element().vdw_radius());
+        const size_t n = molecules[m].atoms().size();
+        for (size_t begin = 0; begin < n; begin += PQR_CHUNK_SIZE) {
+            tasks.push_back({m, begin, std::min(n, begin + PQR_CHUNK_SIZE)});
         }
     }
-    catch (std::out_of_range &) {
-        /* Do nothing */
+
+    std::vector<std::string> chunks(tasks.size());
+
+    #pragma omp parallel for schedule(dynamic) default(none) shared(molecules, chg, tasks, chunks, multiple_models)
+    for (size_t t = 0; t < tasks.size(); t++) {
+        const auto &[m, begin, end] = tasks[t];
+
+        TextBuffer buffer;
+        append_atoms(buffer, molecules[m], chg[m], begin, end, multiple_models ? m + 1 : 0);
+        chunks[t] = buffer.release();
     }
 
-    fclose(file);
+    write_chunks(filename, chunks);
 }
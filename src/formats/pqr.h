@@ -1,13 +1,19 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "writer.h"
 #include "../structures/molecule_set.h"
 #include "../charges.h"
+#include "../utility/text_buffer.h"
 
 
 class PQR final: public Writer {
 public:
+    /* Atoms [begin, end) of the molecule; model > 0 wraps the whole molecule in MODEL/ENDMDL records */
+    static void append_atoms(TextBuffer &buffer, const Molecule &molecule, const std::vector<double> &charges,
+                             size_t begin, size_t end, size_t model = 0);
+
     void save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) override;
 };
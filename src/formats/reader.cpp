@@ -6,28 +6,47 @@
 #include "sdf.h"
 #include "pdb.h"
 #include "mmcif.h"
+#include "bcif.h"
+#include "fw2bin.h"
 #include "mol2.h"
 #include "../utility/strings.h"
+#include "../utility/compression.h"
 #include "../utility/exceptions.h"
 
 
 Reader::~Reader() = default;
 
-MoleculeSet load_molecule_set(const std::string &filename) {
-    auto ext = std::filesystem::path(filename).extension().string();
+static std::unique_ptr<Reader> reader_for(const std::string &filename) {
+    /* Compressed files are recognized by the extension preceding .gz/.zst */
+    auto ext = to_lowercase(std::filesystem::path(strip_compression_extension(filename)).extension().string());
 
-    std::unique_ptr<Reader> reader;
-    ext = to_lowercase(ext);
     if (ext == ".sdf") {
-        reader = std::make_unique<SDF>();
+        return std::make_unique<SDF>();
     } else if (ext == ".mol2") {
-        reader = std::make_unique<Mol2>();
+        return std::make_unique<Mol2>();
     } else if (ext == ".pdb" or ext == ".ent") {
-        reader = std::make_unique<PDB>();
+        return std::make_unique<PDB>();
     } else if (ext == ".cif") {
-        reader = std::make_unique<mmCIF>();
-    } else {
-        throw FileException(std::format("Filetype {} not supported", ext));
+        return std::make_unique<mmCIF>();
+    } else if (ext == ".bcif") {
+        return std::make_unique<BCIF>();
+    } else if (ext == ".fw2bin") {
+        return std::make_unique<FW2Bin>();
+    }
+    return nullptr;
+}
+
+
+bool is_supported_input_file(const std::string &filename) {
+    return reader_for(filename) != nullptr;
+}
+
+
+MoleculeSet load_molecule_set(const std::string &filename) {
+    auto reader = reader_for(filename);
+    if (not reader) {
+        auto ext = std::filesystem::path(strip_compression_extension(filename)).extension().string();
+        throw FileException(std::format("Filetype {} not supported", to_lowercase(ext)));
     }
 
     return reader->read_file(filename);
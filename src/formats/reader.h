@@ -12,4 +12,7 @@ public:
 };
 
 
+/* Whether the extension of the file (ignoring the compression suffix) is one of the readable formats */
+bool is_supported_input_file(const std::string &filename);
+
 MoleculeSet load_molecule_set(const std::string &filename);
@@ -1,30 +1,210 @@
 #include <filesystem>
+#include <format>
+#include <functional>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <vector>
 
 #include "../charges.h"
 #include "../config.h"
 #include "../structures/molecule_set.h"
+#include "../utility/compression.h"
+#include "../utility/exceptions.h"
+#include "../utility/text_buffer.h"
 #include "cif.h"
 #include "mol2.h"
+#include "npz.h"
 #include "pqr.h"
 #include "save_charges.h"
 #include "txt.h"
 
+/* Without explicit selection, write TXT, CIF and either PQR (proteins) or Mol2 */
+static std::vector<std::string> selected_formats(const MoleculeSet &ms) {
+  auto formats = config::output_formats;
+  if (formats.empty()) {
+    formats = {"txt", "cif", ms.has_proteins() ? "pqr" : "mol2"};
+  }
+  return formats;
+}
+
+static std::string output_path(const std::string &filename, const std::string &ext, bool compressed = true) {
+  std::filesystem::path out_dir(config::chg_out_dir);
+  auto file_path = std::filesystem::path(strip_compression_extension(filename));
+  auto suffix = compressed ? compression_extension(compression_from_name(config::output_compression)) : "";
+  return (out_dir / std::filesystem::path(file_path.filename().string() + "." + ext + suffix)).string();
+}
+
+static void run_writers(const MoleculeSet &ms, const Charges &charges, const std::string &filename,
+                        const std::string &input_file, const std::vector<std::string> &formats) {
+  std::vector<std::function<void()>> writers;
+  for (const auto &format: formats) {
+    if (format == "txt") {
+      writers.emplace_back([&, path = output_path(filename, "txt")] { TXT().save_charges(ms, charges, path); });
+    } else if (format == "cif") {
+      writers.emplace_back([&] { CIF(input_file).save_charges(ms, charges, filename); });
+    } else if (format == "pqr") {
+      writers.emplace_back([&, path = output_path(filename, "pqr")] { PQR().save_charges(ms, charges, path); });
+    } else if (format == "npz") {
+      /* The archive is a container of its own, so the output compression is not applied */
+      writers.emplace_back([&, path = output_path(filename, "npz", false)] { NPZ().save_charges(ms, charges, path); });
+    } else if (format == "mol2") {
+      writers.emplace_back([&, path = output_path(filename, "mol2")] { Mol2().save_charges(ms, charges, path); });
+    } else {
+      throw ParameterException(std::format("Unknown output format: {}", format));
+    }
+  }
+
+  /* Writers only read the molecules and charges, so they can run concurrently */
+  std::vector<std::future<void>> results;
+  for (auto &writer: writers) {
+    results.push_back(std::async(std::launch::async, writer));
+  }
+
+  for (auto &result: results) {
+    result.wait();
+  }
+
+  for (auto &result: results) {
+    result.get();
+  }
+}
+
 void save_charges(const MoleculeSet &ms, const Charges &charges,
                   const std::string &filename) {
-  std::filesystem::path out_dir(config::chg_out_dir);
-  auto file_path = std::filesystem::path(filename);
+  save_charges(ms, charges, filename, config::input_file);
+}
+
+void save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename,
+                  const std::string &input_file) {
+  run_writers(ms, charges, filename, input_file, selected_formats(ms));
+}
+
+ChargesOutput::ChargesOutput(const MoleculeSet &ms, const std::string &method_name,
+                             const std::string &parameters_name, std::string filename, std::string input_file)
+    : ms_(ms), filename_(std::move(filename)), input_file_(input_file.empty() ? filename_ : std::move(input_file)),
+      charges_(method_name, parameters_name),
+      results_(ms.molecules().size()), ready_(ms.molecules().size(), false) {
+  formats_ = selected_formats(ms);
+  for (const auto &format: formats_) {
+    if (format != "txt" and format != "cif" and format != "pqr" and format != "mol2" and format != "npz") {
+      throw ParameterException(std::format("Unknown output format: {}", format));
+    }
+  }
+  thread_ = std::thread(&ChargesOutput::run, this);
+}
 
-  auto txt_str = file_path.filename().string() + ".txt";
-  TXT().save_charges(ms, charges, out_dir / std::filesystem::path(txt_str));
+ChargesOutput::~ChargesOutput() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard lock(mutex_);
+      aborted_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+}
 
-  CIF().save_charges(ms, charges, filename);
+void ChargesOutput::submit(size_t index, std::vector<double> charges) {
+  {
+    std::lock_guard lock(mutex_);
+    results_[index] = std::move(charges);
+    ready_[index] = true;
+  }
+  cv_.notify_one();
+}
 
-  if (ms.has_proteins()) {
-    auto pqr_str = file_path.filename().string() + ".pqr";
-    PQR().save_charges(ms, charges, out_dir / std::filesystem::path(pqr_str));
-  } else {
-    auto mol2_str = file_path.filename().string() + ".mol2";
-    Mol2().save_charges(ms, charges,
-                        out_dir / std::filesystem::path(mol2_str));
+void ChargesOutput::skip(size_t index) {
+  {
+    std::lock_guard lock(mutex_);
+    ready_[index] = true;
   }
+  cv_.notify_one();
+}
+
+void ChargesOutput::run() {
+  const std::set<std::string> formats(formats_.begin(), formats_.end());
+  const auto &molecules = ms_.molecules();
+  const bool multiple_models = molecules.size() > 1;
+  const std::string comment = Mol2::charges_comment(charges_.method_name());
+
+  try {
+    std::unique_ptr<std::ostream> txt;
+    std::unique_ptr<std::ostream> mol2;
+    std::unique_ptr<std::ostream> pqr;
+    if (formats.contains("txt")) {
+      txt = open_output_stream(output_path(filename_, "txt"));
+    }
+    if (formats.contains("mol2")) {
+      mol2 = open_output_stream(output_path(filename_, "mol2"));
+    }
+    if (formats.contains("pqr")) {
+      pqr = open_output_stream(output_path(filename_, "pqr"));
+    }
+
+    auto write = [](std::ostream &out, TextBuffer &buffer) {
+      auto data = buffer.release();
+      out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    };
+
+    for (size_t i = 0; i < molecules.size(); i++) {
+      std::optional<std::vector<double>> result;
+      {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [&] { return ready_[i] or aborted_; });
+        if (aborted_) {
+          return;
+        }
+        result = std::move(results_[i]);
+      }
+
+      if (not result.has_value()) {
+        continue;
+      }
+
+      const auto &molecule = molecules[i];
+      TextBuffer buffer;
+      if (txt) {
+        TXT::append_molecule(buffer, molecule.name(), *result);
+        write(*txt, buffer);
+      }
+      if (mol2) {
+        Mol2::append_molecule(buffer, molecule, *result, comment);
+        write(*mol2, buffer);
+      }
+      if (pqr) {
+        PQR::append_atoms(buffer, molecule, *result, 0, molecule.atoms().size(), multiple_models ? i + 1 : 0);
+        write(*pqr, buffer);
+      }
+
+      charges_.insert(molecule.name(), std::move(*result));
+    }
+
+    for (const auto &[stream, ext]: {std::pair{txt.get(), "txt"}, std::pair{mol2.get(), "mol2"},
+                                     std::pair{pqr.get(), "pqr"}}) {
+      if (stream != nullptr) {
+        close_output_stream(*stream, output_path(filename_, ext));
+      }
+    }
+  } catch (...) {
+    error_ = std::current_exception();
+  }
+}
+
+Charges ChargesOutput::finish() {
+  thread_.join();
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+
+  std::vector<std::string> remaining;
+  for (const auto &format: formats_) {
+    if (format != "txt" and format != "mol2" and format != "pqr") {
+      remaining.push_back(format);
+    }
+  }
+  run_writers(ms_, charges_, filename_, input_file_, remaining);
+
+  return std::move(charges_);
 }
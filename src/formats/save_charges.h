@@ -1,8 +1,58 @@
 #pragma once
 
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "../charges.h"
 #include "../structures/molecule_set.h"
 
 void save_charges(const MoleculeSet& ms, const Charges& charges, const std::string& filename);
+
+/* The same for molecules which were not read from config::input_file */
+void save_charges(const MoleculeSet& ms, const Charges& charges, const std::string& filename,
+                  const std::string& input_file);
+
+/* Output stage overlapping writing with computation. Results may be submitted in any order and from any thread;
+ * TXT, Mol2 and PQR output is formatted and written by a dedicated thread in molecule order, other formats need
+ * all charges and are written by finish() */
+class ChargesOutput {
+  const MoleculeSet& ms_;
+  std::string filename_;
+  std::string input_file_;
+  std::vector<std::string> formats_{};
+  Charges charges_;
+
+  std::vector<std::optional<std::vector<double>>> results_{};
+  std::vector<bool> ready_{};
+  bool aborted_{false};
+  std::mutex mutex_{};
+  std::condition_variable cv_{};
+  std::exception_ptr error_{};
+  std::thread thread_{};
+
+  void run();
+
+ public:
+  /* Output files are named after the filename; the input file (the same one if not given) is needed by mmCIF output */
+  ChargesOutput(const MoleculeSet& ms, const std::string& method_name, const std::string& parameters_name,
+                std::string filename, std::string input_file = {});
+
+  ChargesOutput(const ChargesOutput&) = delete;
+
+  ChargesOutput& operator=(const ChargesOutput&) = delete;
+
+  ~ChargesOutput();
+
+  void submit(size_t index, std::vector<double> charges);
+
+  /* The molecule has no charges, but the writer must not wait for it */
+  void skip(size_t index);
+
+  /* Wait for the streamed output, write the remaining formats and return all charges */
+  Charges finish();
+};
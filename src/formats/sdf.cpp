@@ -1,5 +1,5 @@
 #include <string>
-#include <fstream>
+#include <istream>
 #include <format>
 #include <print>
 #include <sstream>
@@ -15,9 +15,10 @@
 #include "common.h"
 #include "sdf.h"
 #include "../utility/exceptions.h"
+#include "../utility/compression.h"
 
 
-void SDF::read_until_end_of_record(std::ifstream &file) {
+void SDF::read_until_end_of_record(std::istream &file) {
     std::string line;
     do {
         std::getline(file, line);
@@ -26,10 +27,8 @@ void SDF::read_until_end_of_record(std::ifstream &file) {
 
 
 MoleculeSet SDF::read_file(const std::string &filename) {
-    std::ifstream file(filename);
-    if (!file) {
-        throw FileException(std::format("Cannot open file: {}", filename));
-    }
+    auto stream = open_input_stream(filename);
+    auto &file = *stream;
 
     std::string line;
     std::string name;
@@ -88,7 +87,7 @@ MoleculeSet SDF::read_file(const std::string &filename) {
 }
 
 
-void SDF::read_V2000(std::ifstream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
+void SDF::read_V2000(std::istream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
                 std::unique_ptr<std::vector<Bond>> &bonds) {
 
     size_t n_atoms = std::stoul(line.substr(0, 3));
@@ -133,7 +132,7 @@ void SDF::read_V2000(std::ifstream &file, std::string &line, std::unique_ptr<std
 }
 
 
-void SDF::read_V3000(std::ifstream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
+void SDF::read_V3000(std::istream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
                 std::unique_ptr<std::vector<Bond>> &bonds) {
     /* Skip 'M  V30 BEGIN CTAB' line */
     std::getline(file, line);
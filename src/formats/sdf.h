@@ -1,18 +1,19 @@
 #pragma once
 
+#include <istream>
 #include <string>
 
 #include "reader.h"
 
 
 class SDF final: public Reader {
-    static void read_V2000(std::ifstream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
+    static void read_V2000(std::istream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
                     std::unique_ptr<std::vector<Bond>> &bonds);
 
-    static void read_V3000(std::ifstream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
+    static void read_V3000(std::istream &file, std::string &line, std::unique_ptr<std::vector<Atom>> &atoms,
                     std::unique_ptr<std::vector<Bond>> &bonds);
 
-    static void read_until_end_of_record(std::ifstream &file);
+    static void read_until_end_of_record(std::istream &file);
 
 public:
     SDF();
@@ -1,28 +1,38 @@
 #include <string>
-#include <format>
-#include <fstream>
+#include <vector>
 
 #include "../charges.h"
 #include "txt.h"
 #include "../utility/strings.h"
-#include "../utility/exceptions.h"
+#include "../utility/compression.h"
+#include "../utility/text_buffer.h"
 
 
-void TXT::save_charges(const MoleculeSet &, const Charges &charges, const std::string &filename) {
-    std::ofstream out(filename);
-    if (!out) {
-        throw FileException(std::format("Cannot open file: {}", filename));
+void TXT::append_molecule(TextBuffer &buffer, const std::string &name, const std::vector<double> &charges) {
+    buffer.reserve(buffer.size() + name.size() + 10 * charges.size() + 2);
+    buffer.append(to_uppercase(name)).append('\n');
+
+    for (size_t j = 0; j < charges.size(); j++) {
+        if (j) {
+            buffer.append(' ');
+        }
+        buffer.append_fixed(charges[j], 5);
     }
+    buffer.append('\n');
+}
 
-    for (const auto &name: charges.names()) {
-        std::println(out, "{}", to_uppercase(name));
-        auto const& vals = charges[name];
 
-        std::string_view sep{};
-        for (double v : vals) {
-            std::print(out, "{}{:.5f}", sep, v);
-            sep = " ";
-        }
-        std::print(out, "\n");
+void TXT::save_charges(const MoleculeSet &, const Charges &charges, const std::string &filename) {
+    const auto names = charges.names();
+    std::vector<std::string> chunks(names.size());
+
+    /* Every molecule is formatted into its own buffer, the buffers are written in the original order */
+    #pragma omp parallel for schedule(dynamic) default(none) shared(names, charges, chunks)
+    for (size_t i = 0; i < names.size(); i++) {
+        TextBuffer buffer;
+        append_molecule(buffer, names[i], charges.values(names[i]));
+        chunks[i] = buffer.release();
     }
+
+    write_chunks(filename, chunks);
 }
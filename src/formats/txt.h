@@ -1,12 +1,16 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "writer.h"
 #include "../charges.h"
+#include "../utility/text_buffer.h"
 
 
 class TXT final: public Writer {
 public:
+    static void append_molecule(TextBuffer &buffer, const std::string &name, const std::vector<double> &charges);
+
     void save_charges(const MoleculeSet &ms, const Charges &charges, const std::string &filename) override;
 };
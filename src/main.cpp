@@ -8,25 +8,293 @@
 #include <cmath>
 #include <unistd.h>
 #include <algorithm>
+#include <iterator>
+#include <format>
+#include <string>
+#include <optional>
 
 #include "chargefw2.h"
+#include "batch.h"
+#include "server.h"
 #include "formats/reader.h"
+#include "formats/fw2bin.h"
 #include "structures/molecule_set.h"
 #include "parameters.h"
 #include "charges.h"
 #include "formats/save_charges.h"
 #include "method.h"
+#include "executor.h"
+#include "ee_method.h"
 #include "candidates.h"
+#include "result_cache.h"
+#include "checkpoint.h"
 #include "config.h"
 #include "method_registry.h"
 #include "options.h"
 #include "utility/install.h"
+#include "utility/compression.h"
 #include "utility/exceptions.h"
+#include "utility/strings.h"
+
+
+/* Append the processed input and the resources used so far to the log file (if requested) */
+static void write_log(const std::string &input, size_t molecules, const std::string &method_name,
+                      const std::string &parameters_name, std::chrono::system_clock::time_point start) {
+    if (config::log_file.empty()) {
+        return;
+    }
+
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    constexpr double MICROSECONDS_IN_SECOND = 1'000'000.0;
+    double utime = usage.ru_utime.tv_sec + static_cast<double>(usage.ru_utime.tv_usec) / MICROSECONDS_IN_SECOND;
+    double stime = usage.ru_stime.tv_sec + static_cast<double>(usage.ru_stime.tv_usec) / MICROSECONDS_IN_SECOND;
+    double mem = static_cast<double>(usage.ru_maxrss) / 1024;
+    auto now = time(nullptr);
+    char current_time[100];
+    strftime(current_time, 100, "%c", localtime(&now));
+    auto end = std::chrono::system_clock::now();
+    std::chrono::duration<double> walltime = end - start;
+
+    auto pid = getpid();
+    auto log_file = std::fopen(config::log_file.c_str(), "a");
+    if (log_file == nullptr) {
+        std::println(stderr, "Unable to open log file {}", config::log_file);
+        exit(to_int(ExitCode::FileError));
+    }
+
+    std::println(log_file, "{} [{}]; File: {}; Processed molecules: {}; Method: {}; Parameters: {}",
+            current_time, pid, input, molecules, method_name, parameters_name);
+
+    std::println(log_file,
+            "{} [{}]; Walltime: {:.2f} s; User time: {:.2f} s; System time: {:.2f} s; Peak memory: {:.1f} MB",
+            current_time, pid, walltime.count(), utime, stime, mem);
+
+    if (FragmentStatistics::global().count()) {
+        std::print(log_file, "{} [{}]; ", current_time, pid);
+        FragmentStatistics::global().print(log_file);
+    }
+
+    std::fclose(log_file);
+}
+
+
+/* Submit finite charges to the output, molecules with numerically incorrect values are reported and skipped */
+static ChargesCallback checked_output(const MoleculeSet &m, ChargesOutput &output) {
+    return [&m, &output](size_t i, std::vector<double> results) {
+        if (std::ranges::any_of(results, [](double chg) noexcept { return not std::isfinite(chg); })) {
+            std::println(stderr, "Cannot compute charges for {}: Method returned numerically incorrect values",
+                    m.molecules()[i].name());
+            output.skip(i);
+            return;
+        }
+        output.submit(i, std::move(results));
+    };
+}
+
+
+/* Compute charges of the selected molecules (all if empty) and write them. Molecules finished by an interrupted run
+ * (with a checkpoint) or computed by an earlier run (with a result cache) are not computed again; the others are added
+ * to both as they are finished */
+static Charges calculate_charges_of(Method &method, const MoleculeSet &m, ChargesOutput &output,
+                                    const std::string &filename, std::vector<bool> selected = {}) {
+    const auto &molecules = m.molecules();
+    if (selected.empty()) {
+        selected.assign(molecules.size(), true);
+    }
+
+    std::optional<Checkpoint> checkpoint;
+    if (config::checkpoint) {
+        const auto name = std::filesystem::path(strip_compression_extension(filename)).filename().string();
+        checkpoint.emplace((std::filesystem::path(config::chg_out_dir) / (name + ".checkpoint")).string(), method,
+                           method.parameters(), molecules.size(), config::resume);
+
+        size_t finished = 0;
+        for (const auto &[i, charges]: checkpoint->completed()) {
+            if (not selected[i]) {
+                continue;
+            }
+            if (charges.empty()) {
+                output.skip(i);
+            } else if (charges.size() == molecules[i].atoms().size()) {
+                output.submit(i, charges);
+            } else {
+                /* Does not belong to this molecule, computed again */
+                continue;
+            }
+            selected[i] = false;
+            finished++;
+        }
+        if (config::resume) {
+            std::println("Molecules finished by the previous run: {}", finished);
+        }
+    }
+
+    std::optional<ResultCache> cache;
+    std::vector<ResultCache::Key> keys(molecules.size());
+    if (not config::result_cache.empty()) {
+        cache.emplace(config::result_cache, method, method.parameters());
+
+        size_t hits = 0;
+        for (size_t i = 0; i < molecules.size(); i++) {
+            if (not selected[i]) {
+                continue;
+            }
+            keys[i] = cache->key(molecules[i]);
+            auto charges = cache->find(keys[i]);
+            if (charges.has_value() and charges->size() == molecules[i].atoms().size()) {
+                output.submit(i, std::move(*charges));
+                selected[i] = false;
+                hits++;
+            }
+        }
+        std::println("Molecules taken from the result cache: {}", hits);
+    }
+
+    auto submit = checked_output(m, output);
+    calculate_all_charges(method, m, [&](size_t i, std::vector<double> results) {
+        const bool finite = std::ranges::all_of(results, [](double chg) noexcept { return std::isfinite(chg); });
+        if (cache and finite) {
+            cache->store(keys[i], results);
+        }
+        if (checkpoint) {
+            checkpoint->record(i, finite ? results : std::vector<double>{});
+        }
+        submit(i, std::move(results));
+    }, selected);
+
+    auto charges = output.finish();
+    if (checkpoint) {
+        checkpoint->remove();
+    }
+    return charges;
+}
+
+
+/* Several methods over one loaded set share the loading and the structures required by the methods (bond information,
+ * distance trees). Atom and bond types are stored in the molecules, so the methods run one after another (each using
+ * all threads), reclassifying the set for their parameters and computing only the molecules covered by them */
+static void calculate_charges_of_methods(MoleculeSet &m, const std::vector<std::string> &method_names,
+                                         const std::vector<std::string> &par_files,
+                                         const boost::program_options::parsed_options &parsed,
+                                         std::chrono::system_clock::time_point start) {
+    std::vector<std::unique_ptr<Method>> methods;
+    std::vector<RequiredFeatures> requirements;
+    for (const auto &name: method_names) {
+        auto method = load_method(name);
+        setup_method_options(*method, parsed);
+        std::ranges::copy(method->get_requirements(), std::back_inserter(requirements));
+        methods.push_back(std::move(method));
+    }
+
+    std::ranges::sort(requirements);
+    const auto duplicates = std::ranges::unique(requirements);
+    requirements.erase(duplicates.begin(), duplicates.end());
+
+    m.classify_atoms(AtomClassifier::PLAIN);
+    m.info();
+    m.fulfill_requirements(requirements);
+
+    /* Outputs of the methods are distinguished the same way as in the Python bindings */
+    const std::filesystem::path input(strip_compression_extension(config::input_file));
+
+    for (size_t k = 0; k < methods.size(); k++) {
+        auto &method = *methods[k];
+        std::println("\nMethod: {}", method.metadata().name);
+
+        std::unique_ptr<Parameters> p;
+        std::vector<bool> covered;
+        if (method.has_parameters()) {
+            if (par_files.empty()) {
+                auto best_par = best_parameters(m, method, m.has_proteins(), config::permissive_types);
+                if (!best_par.has_value()) {
+                    std::println(stderr, "No parameters found for method {}", method.metadata().name);
+                    exit(to_int(ExitCode::ParameterError));
+                }
+                p = std::move(best_par.value());
+            } else {
+                try {
+                    p = std::make_unique<Parameters>(InstallPaths::parametersdir() / (par_files[k] + ".json"));
+                } catch (std::runtime_error &e) {
+                    std::println(stderr, "{}", e.what());
+                    exit(to_int(ExitCode::FileError));
+                }
+            }
+            std::println("Parameters: {}", p->name());
+
+            covered = m.classify_set_from_parameters_masked(*p, config::permissive_types);
+            std::println("Number of unclassified molecules: {}", std::ranges::count(covered, false));
+
+            try {
+                method.set_parameters(p.get());
+            } catch (std::runtime_error &e) {
+                std::println(stderr, "{}", e.what());
+                exit(to_int(ExitCode::FileError));
+            }
+        } else {
+            m.classify_atoms(AtomClassifier::PLAIN);
+        }
+
+        const std::string parameters_name = p ? p->metadata().internal_name : "None";
+        const auto filename = input.parent_path() / std::format("{}-{}-{}{}", input.stem().string(),
+                                                                method.metadata().internal_name, parameters_name,
+                                                                input.extension().string());
+
+        ChargesOutput output(m, method.metadata().name, p ? p->name() : "None", filename.string(),
+                             config::input_file);
+        for (size_t i = 0; i < covered.size(); i++) {
+            if (not covered[i]) {
+                output.skip(i);
+            }
+        }
+
+        auto charges = calculate_charges_of(method, m, output, filename.string(), covered);
+        const auto processed = covered.empty() ? m.molecules().size()
+                                               : static_cast<size_t>(std::ranges::count(covered, true));
+        write_log(config::input_file, processed, method.metadata().name, charges.parameters_name(), start);
+    }
+
+    FragmentStatistics::global().print(stdout);
+}
+
+
+/* Print the predicted costs of the solver modes for each molecule and the mode that would be selected */
+static void print_plan(MoleculeSet &m, const std::string &method_name,
+                       const boost::program_options::parsed_options &parsed) {
+    auto method = load_method(method_name);
+    setup_method_options(*method, parsed);
+    std::println("Method: {}", method->metadata().name);
+
+    const auto *ee_method = dynamic_cast<const EEMethod *>(method.get());
+    if (ee_method == nullptr) {
+        std::println("The method does not solve an equalization system, there is no solver mode to select");
+        return;
+    }
+
+    m.classify_atoms(AtomClassifier::PLAIN);
+    m.fulfill_requirements(method->get_requirements());
+
+    const auto available_memory = available_solver_memory();
+    std::println("Available memory: {:.0f} MB; Accuracy: {}\n", available_memory / 1e6, config::accuracy);
+
+    for (const auto &molecule: m.molecules()) {
+        const auto costs = ee_method->estimate_costs(molecule);
+        const auto &selected = ee_method->select_mode(costs, available_memory);
+        std::println("{} ({} atoms): {}", molecule.name(), molecule.atoms().size(), selected.mode);
+        for (const auto &cost: costs) {
+            std::println("  {:<6} fragments: {:>8}; largest: {:>8} atoms; memory: {:>10.1f} MB; {:>12.3f} GFLOP{}",
+                         cost.mode, cost.fragments, cost.fragment_atoms, cost.memory / 1e6, cost.flops / 1e9,
+                         cost.memory > available_memory ? " (exceeds memory)" : "");
+        }
+    }
+}
 
 
 int main(int argc, char **argv) {
     auto parsed = parse_args(argc, argv);
     check_common_args();
+    set_thread_count(config::threads);
 
     auto start = std::chrono::system_clock::now();
 
@@ -41,9 +309,36 @@ int main(int argc, char **argv) {
             exit(to_int(ExitCode::Success));
         }
 
+        if (config::mode == "serve") {
+            serve(config::socket_path);
+        }
+
+        if (config::mode == "batch") {
+            auto files = collect_batch_inputs(config::input_file, config::input_list);
+            if (files.empty()) {
+                std::println(stderr, "No input files found");
+                exit(to_int(ExitCode::FileError));
+            }
+
+            auto summary = run_batch(files, config::method_name, parsed);
+            std::println("Processed files: {}; Failed: {}; Processed molecules: {}", summary.files - summary.failed,
+                         summary.failed, summary.molecules);
+            FragmentStatistics::global().print(stdout);
+
+            auto input = config::input_file.empty() ? config::input_list : config::input_file;
+            write_log(std::format("{} ({} files)", input, summary.files), summary.molecules, summary.method_name,
+                      config::par_file.empty() ? "Best for each file" : config::par_file, start);
+
+            exit(to_int(summary.failed ? ExitCode::FileError : ExitCode::Success));
+        }
+
         MoleculeSet m;
         try {
-            m = load_molecule_set(config::input_file);
+            if (config::cache_file.empty()) {
+                m = load_molecule_set(config::input_file);
+            } else {
+                m = load_molecule_set_cached(config::input_file, config::cache_file);
+            }
         }
         catch (std::runtime_error &e) {
             std::println(stderr, "{}: {}", config::input_file, e.what());
@@ -62,8 +357,14 @@ int main(int argc, char **argv) {
             m.info();
 
         } else if (config::mode == "charges") {
+            const auto method_names = split(config::method_name, ',');
+            if (method_names.size() > 1) {
+                calculate_charges_of_methods(m, method_names, split(config::par_file, ','), parsed, start);
+                exit(to_int(ExitCode::Success));
+            }
+
             std::string method_name;
-            if (config::method_name.empty()) {
+            if (method_names.empty()) {
                 auto methods = get_suitable_methods(m, all_methods, is_protein_structure, config::permissive_types);
                 if (methods.empty()) {
                     std::println(stderr, "No suitable methods found for the given molecule(s)");
@@ -72,7 +373,7 @@ int main(int argc, char **argv) {
                 method_name = std::get<0>(methods.front())->metadata().internal_name;
                 std::println("Autoselecting the best method.");
             } else {
-                method_name = config::method_name;
+                method_name = method_names.front();
             }
 
             auto method = load_method(method_name);
@@ -120,50 +421,17 @@ int main(int argc, char **argv) {
             m.info();
             m.fulfill_requirements(method->get_requirements());
 
-            auto charges = Charges(method->metadata().name, method->has_parameters() ? method->parameters()->name(): "None");
-
-            for (auto &mol: m.molecules()) {
-                auto results = method->calculate_charges(mol);
-                if (std::ranges::any_of(results, [](double chg) noexcept { return not std::isfinite(chg); })) {
-                    std::println(stderr, "Cannot compute charges for {}: Method returned numerically incorrect values",
-                            mol.name());
-                    continue;
-                }
-                charges.insert(mol.name(), results);
-            }
-
-            save_charges(m, charges, config::input_file);
-
-            if (not config::log_file.empty()) {
-                struct rusage usage = {};
-                getrusage(RUSAGE_SELF, &usage);
-
-                constexpr double MICROSECONDS_IN_SECOND = 1'000'000.0;
-                double utime = usage.ru_utime.tv_sec + static_cast<double>(usage.ru_utime.tv_usec) / MICROSECONDS_IN_SECOND;
-                double stime = usage.ru_stime.tv_sec + static_cast<double>(usage.ru_stime.tv_usec) / MICROSECONDS_IN_SECOND;
-                double mem = static_cast<double>(usage.ru_maxrss) / 1024;
-                auto now = time(nullptr);
-                char current_time[100];
-                strftime(current_time, 100, "%c", localtime(&now));
-                auto end = std::chrono::system_clock::now();
-                std::chrono::duration<double> walltime = end - start;
-
-                auto pid = getpid();
-                auto log_file = std::fopen(config::log_file.c_str(), "a");
-                if (log_file == nullptr) {
-                    std::println(stderr, "Unable to open log file {}", config::log_file);
-                    exit(to_int(ExitCode::FileError));
-                }
-
-                std::println(log_file, "{} [{}]; File: {}; Processed molecules: {}; Method: {}; Parameters: {}",
-                        current_time, pid, config::input_file, m.molecules().size(), method->metadata().name, charges.parameters_name());
+            /* Charges are written by a separate thread while the next molecules are being computed */
+            ChargesOutput output(m, method->metadata().name,
+                                 method->has_parameters() ? method->parameters()->name() : "None", config::input_file);
 
-                std::println(log_file,
-                        "{} [{}]; Walltime: {:.2f} s; User time: {:.2f} s; System time: {:.2f} s; Peak memory: {:.1f} MB",
-                        current_time, pid, walltime.count(), utime, stime, mem);
+            auto charges = calculate_charges_of(*method, m, output, config::input_file);
+            FragmentStatistics::global().print(stdout);
 
-                std::fclose(log_file);
-            }
+            write_log(config::input_file, m.molecules().size(), method->metadata().name, charges.parameters_name(),
+                      start);
+        } else if (config::mode == "plan") {
+            print_plan(m, config::method_name, parsed);
         } else if (config::mode == "best-parameters") {
             const auto method = load_method(config::method_name);
 
@@ -1,3 +1,4 @@
+#include <array>
 #include <vector>
 #include <cmath>
 #include <Eigen/LU>
@@ -10,10 +11,21 @@
 [[maybe_unused]] const bool ABEEM_registered_ =
     (MethodRegistry::register_factory("abeem", &make_method<ABEEM>), true);
 
-std::vector<double> ABEEM::calculate_charges(const Molecule &molecule) const {
 
-    const auto n = static_cast<Eigen::Index>(molecule.atoms().size());
-    const auto m = static_cast<Eigen::Index>(molecule.bonds().size());
+static double point_distance(const std::array<double, 3> &p1, const std::array<double, 3> &p2) {
+    double dx = p1[0] - p2[0];
+    double dy = p1[1] - p2[1];
+    double dz = p1[2] - p2[2];
+
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+
+Eigen::VectorXd ABEEM::EE_system(const std::vector<const Atom *> &atoms, const std::vector<FragmentBond> &bonds,
+                                 double total_charge) const {
+
+    const auto n = static_cast<Eigen::Index>(atoms.size());
+    const auto m = static_cast<Eigen::Index>(bonds.size());
     const auto mn = n + m + 1;
 
     Eigen::MatrixXd A = Eigen::MatrixXd::Zero(mn, mn);
@@ -21,58 +33,59 @@ std::vector<double> ABEEM::calculate_charges(const Molecule &molecule) const {
 
     const double k = parameters_->common()->parameter(common::k);
 
+    /* Parameters and weighted bond centers are looked up once instead of for every pair */
+    Eigen::VectorXd atom_c(n);
+    for (Eigen::Index i = 0; i < n; i++) {
+        const auto &atom = *atoms[i];
+        A(i, i) = parameters_->atom()->parameter(atom::b)(atom);
+        b(i) = -parameters_->atom()->parameter(atom::a)(atom);
+        atom_c(i) = parameters_->atom()->parameter(atom::c)(atom);
+    }
+
+    std::vector<std::array<double, 3>> centers(m);
+    Eigen::VectorXd bond_C(m);
+    Eigen::VectorXd bond_D(m);
+    for (Eigen::Index i = 0; i < m; i++) {
+        const auto &bond = *bonds[i].bond;
+        centers[i] = bond.get_center(true);
+        A(n + i, n + i) = parameters_->bond()->parameter(bond::B)(bond);
+        b(n + i) = -parameters_->bond()->parameter(bond::A)(bond);
+        bond_C(i) = parameters_->bond()->parameter(bond::C)(bond);
+        bond_D(i) = parameters_->bond()->parameter(bond::D)(bond);
+    }
+
     // atom-atom part
+#pragma omp parallel for schedule(dynamic, 16) default(none) shared(A, atoms) firstprivate(n, k)
     for (Eigen::Index i = 0; i < n; i++) {
-        const auto &atom_i = molecule.atoms()[i];
-        A(i, i) = parameters_->atom()->parameter(atom::b)(atom_i);
-        b(i) = -parameters_->atom()->parameter(atom::a)(atom_i);
         for (Eigen::Index j = i + 1; j < n; j++) {
-            const auto &atom_j = molecule.atoms()[j];
-            double off = k / distance(atom_i, atom_j);
+            double off = k / distance(*atoms[i], *atoms[j]);
             A(i, j) = off;
             A(j, i) = off;
         }
     }
 
-    // atom-bond part
-    for (Eigen::Index i = 0; i < n; i++) {
-        const auto &atom = molecule.atoms()[i];
-        for (Eigen::Index j = 0; j < m; j++) {
-            const auto &bond = molecule.bonds()[j];
-            if (bond.hasAtom(atom)) {
-                A(i, n + j) = parameters_->atom()->parameter(atom::c)(atom);
+    // atom-bond and bond-atom parts, the atoms of a bond interact with it through its parameters
+#pragma omp parallel for default(none) shared(A, atoms, bonds, centers, atom_c, bond_C, bond_D) firstprivate(n, m, k)
+    for (Eigen::Index j = 0; j < m; j++) {
+        const auto first = static_cast<Eigen::Index>(bonds[j].first);
+        const auto second = static_cast<Eigen::Index>(bonds[j].second);
+        for (Eigen::Index i = 0; i < n; i++) {
+            if (i == first or i == second) {
+                A(i, n + j) = atom_c(i);
+                A(n + j, i) = i == first ? bond_D(j) : bond_C(j);
             } else {
-                A(i, n + j) = k / distance(atom, bond, true);
-            }
-        }
-
-    }
-
-    // bond-atom part
-    for (Eigen::Index i = 0; i < m; i++) {
-        const auto &bond = molecule.bonds()[i];
-        b(n + i) = -parameters_->bond()->parameter(bond::A)(bond);
-        for (Eigen::Index j = 0; j < n; j++) {
-            const auto &atom = molecule.atoms()[j];
-            if (bond.hasAtom(atom)) {
-                if (bond.first() == atom) {
-                    A(n + i, j) = parameters_->bond()->parameter(bond::D)(bond);
-                } else {
-                    A(n + i, j) = parameters_->bond()->parameter(bond::C)(bond);
-                }
-            } else {
-                A(n + i, j) = k / distance(atom, bond, true);
+                double off = k / point_distance(atoms[i]->pos(), centers[j]);
+                A(i, n + j) = off;
+                A(n + j, i) = off;
             }
         }
     }
 
     // bond-bond part
+#pragma omp parallel for schedule(dynamic, 16) default(none) shared(A, centers) firstprivate(n, m, k)
     for (Eigen::Index i = 0; i < m; i++) {
-        const auto &bond_i = molecule.bonds()[i];
-        A(n + i, n + i) = parameters_->bond()->parameter(bond::B)(bond_i);
         for (Eigen::Index j = i + 1; j < m; j++) {
-            const auto &bond_j = molecule.bonds()[j];
-            double off = k / distance(bond_i, bond_j, true);
+            double off = k / point_distance(centers[i], centers[j]);
             A(n + i, n + j) = off;
             A(n + j, n + i) = off;
         }
@@ -84,16 +97,28 @@ std::vector<double> ABEEM::calculate_charges(const Molecule &molecule) const {
     }
 
     A(n + m, n + m) = 0;
-    b(n + m) = molecule.total_charge();
+    b(n + m) = total_charge;
 
     Eigen::VectorXd q = A.partialPivLu().solve(b).head(mn);
 
     // Redistribute the bond charges to the corresponding atoms
-    for(Eigen::Index i = 0; i < m; i++) {
-        const auto &bond = molecule.bonds()[i];
-        q(static_cast<Eigen::Index>(bond.first().index())) += 0.5 * q(n + i);
-        q(static_cast<Eigen::Index>(bond.second().index())) += 0.5 * q(n + i);
+    for (Eigen::Index i = 0; i < m; i++) {
+        q(static_cast<Eigen::Index>(bonds[i].first)) += 0.5 * q(n + i);
+        q(static_cast<Eigen::Index>(bonds[i].second)) += 0.5 * q(n + i);
     }
 
-    return {q.data(), q.data() + n};
+    return q.head(n);
+}
+
+
+std::vector<double> ABEEM::calculate_charges(const Molecule &molecule) const {
+    const AtomBonds atom_bonds(molecule);
+
+    /* Fragments contain the bonds between their atoms */
+    auto f = [this, &molecule, &atom_bonds](const std::vector<const Atom *> &atoms, double total_charge) {
+        return EE_system(atoms, fragment_bonds(molecule, atom_bonds, atoms), total_charge);
+    };
+
+    Eigen::VectorXd q = solve_EE(molecule, f);
+    return {q.data(), q.data() + q.size()};
 }
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <Eigen/Core>
 #include <vector>
 
 #include "../structures/molecule.h"
 #include "../method.h"
+#include "../ee_method.h"
 
 
-class ABEEM final: public Method {
+class ABEEM final: public EEMethod {
     inline static const MethodMetadata METADATA = {
         .name = "ABEEM",
         .internal_name = "abeem",
@@ -20,8 +22,11 @@ class ABEEM final: public Method {
     enum atom{a, b, c};
     enum bond{A, B, C, D};
 
+    [[nodiscard]] Eigen::VectorXd EE_system(const std::vector<const Atom *> &atoms,
+                                            const std::vector<FragmentBond> &bonds, double total_charge) const;
+
 public:
-    explicit ABEEM() : Method({"k"}, {"a", "b", "c"}, {"A", "B", "C", "D"}, {}) {}
+    explicit ABEEM() : EEMethod({"k"}, {"a", "b", "c"}, {"A", "B", "C", "D"}, {}) {}
 
     [[nodiscard]] const MethodMetadata& metadata() const override {
         return METADATA;
@@ -29,5 +34,8 @@ public:
     
     [[nodiscard]] std::vector<double> calculate_charges(const Molecule &molecule) const override;
 
-    [[nodiscard]] bool is_suitable_for_large_molecule() const override { return false; }
+    /* Charges of atoms and bonds with the total charge constraint */
+    [[nodiscard]] size_t system_size(size_t atoms, size_t bonds) const override {
+        return atoms + bonds + 1;
+    }
 };
@@ -1,4 +1,6 @@
-#include <Eigen/LU>
+#include <limits>
+#include <Eigen/Sparse>
+#include <Eigen/SparseLU>
 
 #include "delre.h"
 #include "../structures/molecule.h"
@@ -16,23 +18,33 @@ std::vector<double> DelRe::calculate_charges(const Molecule &molecule) const {
     const auto n = static_cast<Eigen::Index>(molecule.atoms().size());
     const auto m = static_cast<Eigen::Index>(molecule.bonds().size());
 
-    Eigen::MatrixXd A = Eigen::MatrixXd::Zero(n, n);
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.reserve(n + 2 * m);
     Eigen::VectorXd b = Eigen::VectorXd::Zero(n);
 
     for (Eigen::Index i = 0; i < n; i++) {
         auto &atom_i = molecule.atoms()[i];
         b(i) = -parameters_->atom()->parameter(atom::delta)(atom_i);
-        A(i, i) = -1.0;
+        triplets.emplace_back(i, i, -1.0);
     }
 
     for (const auto &bond: molecule.bonds()) {
         auto i = static_cast<Eigen::Index>(bond.first().index());
         auto j = static_cast<Eigen::Index>(bond.second().index());
-        A(i, j) = parameters_->bond()->parameter(bond::gammaA)(bond);
-        A(j, i) = parameters_->bond()->parameter(bond::gammaB)(bond);
+        triplets.emplace_back(i, j, parameters_->bond()->parameter(bond::gammaA)(bond));
+        triplets.emplace_back(j, i, parameters_->bond()->parameter(bond::gammaB)(bond));
     }
 
-    Eigen::VectorXd d = A.partialPivLu().solve(b);
+    /* The matrix has the sparsity of the bond graph but is not symmetric */
+    Eigen::SparseMatrix<double> A(n, n);
+    A.setFromTriplets(triplets.begin(), triplets.end());
+
+    Eigen::SparseLU<Eigen::SparseMatrix<double>> lu(A);
+    if (lu.info() != Eigen::Success) {
+        return std::vector<double>(n, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    Eigen::VectorXd d = lu.solve(b);
     std::vector<double> q(n, 0);
 
     for (Eigen::Index k = 0; k < m; k++) {
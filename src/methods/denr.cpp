@@ -1,5 +1,8 @@
 #include <vector>
-#include <Eigen/LU>
+#include <limits>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseLU>
 
 #include "denr.h"
 #include "../parameters.h"
@@ -13,32 +16,64 @@ std::vector<double> DENR::calculate_charges(const Molecule &molecule) const {
 
     const auto n = static_cast<Eigen::Index>(molecule.atoms().size());
 
-    Eigen::MatrixXd eta = Eigen::MatrixXd::Zero(n, n);
-    Eigen::MatrixXd L = Eigen::MatrixXd::Zero(n, n);
+    Eigen::VectorXd eta = Eigen::VectorXd::Zero(n);
     Eigen::VectorXd chi = Eigen::VectorXd::Zero(n);
     Eigen::VectorXd q = Eigen::VectorXd::Zero(n);
 
     for (Eigen::Index i = 0; i < n; i++) {
         auto &atom_i = molecule.atoms()[i];
         chi(i) = parameters_->atom()->parameter(atom::electronegativity)(atom_i);
-        eta(i, i) = parameters_->atom()->parameter(atom::hardness)(atom_i);
+        eta(i) = parameters_->atom()->parameter(atom::hardness)(atom_i);
     }
 
-    for (const auto &bond: molecule.bonds()) {
-        auto i1 = static_cast<Eigen::Index>(bond.first().index());
-        auto i2 = static_cast<Eigen::Index>(bond.second().index());
-        L(i1, i1) += 1;
-        L(i2, i2) += 1;
-        L(i1, i2) -= 1;
-        L(i2, i1) -= 1;
+    double step = parameters_->common()->parameter(common::step);
+    double iterations = parameters_->common()->parameter(common::iterations);
+
+    /* Matrix step * L * diag(scale) + diag(diagonal) for the bond graph Laplacian L */
+    auto assemble = [&molecule, n, step](const Eigen::VectorXd &scale, const Eigen::VectorXd &diagonal) {
+        std::vector<Eigen::Triplet<double>> triplets;
+        triplets.reserve(n + 4 * molecule.bonds().size());
+        for (Eigen::Index i = 0; i < n; i++) {
+            triplets.emplace_back(i, i, diagonal(i));
+        }
+        for (const auto &bond: molecule.bonds()) {
+            auto i1 = static_cast<Eigen::Index>(bond.first().index());
+            auto i2 = static_cast<Eigen::Index>(bond.second().index());
+            triplets.emplace_back(i1, i1, step * scale(i1));
+            triplets.emplace_back(i2, i2, step * scale(i2));
+            triplets.emplace_back(i1, i2, -step * scale(i2));
+            triplets.emplace_back(i2, i1, -step * scale(i1));
+        }
+        Eigen::SparseMatrix<double> A(n, n);
+        A.setFromTriplets(triplets.begin(), triplets.end());
+        return A;
+    };
+
+    const Eigen::VectorXd ones = Eigen::VectorXd::Ones(n);
+    Eigen::VectorXd tmp = assemble(ones, Eigen::VectorXd::Zero(n)) * chi;
+
+    /* For positive hardness and step, I + step * L * eta = (eta^-1 + step * L) * eta where the first factor is symmetric
+     * positive definite; it is factorized once and reused by all iterations */
+    if (step > 0 and (eta.array() > 0).all()) {
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt(assemble(ones, eta.cwiseInverse()));
+        if (ldlt.info() == Eigen::Success) {
+            for (int i = 0; i < iterations; i++) {
+                Eigen::VectorXd rhs = q - tmp;
+                q = ldlt.solve(rhs).cwiseQuotient(eta);
+            }
+            return {q.data(), q.data() + q.size()};
+        }
     }
 
-    double step = parameters_->common()->parameter(common::step);
+    Eigen::SparseLU<Eigen::SparseMatrix<double>> lu(assemble(eta, ones));
+    if (lu.info() != Eigen::Success) {
+        return std::vector<double>(n, std::numeric_limits<double>::quiet_NaN());
+    }
 
-    Eigen::PartialPivLU<Eigen::MatrixXd> x = (Eigen::MatrixXd::Identity(n, n) + step * L * eta).partialPivLu();
-    Eigen::VectorXd tmp = step * L * chi;
-    for (int i = 0; i < parameters_->common()->parameter(common::iterations); i++) {
-        q = x.solve(q - tmp);
+    /* The right-hand side is evaluated first, sparse solvers do not handle aliasing with the result */
+    for (int i = 0; i < iterations; i++) {
+        Eigen::VectorXd rhs = q - tmp;
+        q = lu.solve(rhs);
     }
 
     return {q.data(), q.data() + q.size()};
@@ -69,20 +69,46 @@ std::vector<double> EQeqC::calculate_charges(const Molecule &molecule) const {
 
     Eigen::VectorXd q = solve_EE(molecule, f);
 
+    /* The correction decays exponentially beyond the covalent radii, so only atoms within the cutoff contribute */
+    const double cutoff = get_option_value<double>("correction_cutoff");
+    const double alpha = parameters_->common()->parameter(common::alpha);
+
+    Eigen::VectorXd Dz(n);
+    Eigen::VectorXd radius(n);
+    for (Eigen::Index i = 0; i < n; i++) {
+        const auto &atom_i = molecule.atoms()[i];
+        Dz(i) = parameters_->atom()->parameter(atom::Dz)(atom_i);
+        radius(i) = atom_i.element().covalent_radius();
+    }
+
+    Eigen::VectorXd correction = Eigen::VectorXd::Zero(n);
+
+#pragma omp parallel for schedule(dynamic, 64) default(none) shared(molecule, Dz, radius, correction) firstprivate(n, cutoff, alpha)
     for (Eigen::Index i = 0; i < n; i++) {
         const auto &atom_i = molecule.atoms()[i];
-        double correction = 0;
-        for (Eigen::Index j = 0; j < n; j++) {
-            if (i == j)
-                continue;
-            const auto &atom_j = molecule.atoms()[j];
-            double tkk = parameters_->atom()->parameter(atom::Dz)(atom_i) - parameters_->atom()->parameter(atom::Dz)(atom_j);
-            double bkk = std::exp(-parameters_->common()->parameter(common::alpha) *
-                                  (distance(atom_i, atom_j) - atom_i.element().covalent_radius() -
-                                   atom_j.element().covalent_radius()));
-            correction += tkk * bkk;
+        double sum = 0;
+        auto add = [&](const Atom &atom_j) {
+            const auto j = static_cast<Eigen::Index>(atom_j.index());
+            if (i == j) {
+                return;
+            }
+            double tkk = Dz(i) - Dz(j);
+            double bkk = std::exp(-alpha * (distance(atom_i, atom_j) - radius(i) - radius(j)));
+            sum += tkk * bkk;
+        };
+
+        if (cutoff > 0) {
+            for (const auto *atom_j: molecule.get_close_atoms(atom_i, cutoff)) {
+                add(*atom_j);
+            }
+        } else {
+            for (const auto &atom_j: molecule.atoms()) {
+                add(atom_j);
+            }
         }
-        q(i) += correction;
+        correction(i) = sum;
     }
+
+    q += correction;
     return {q.data(), q.data() + q.size()};
 }
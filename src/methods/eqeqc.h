@@ -23,7 +23,11 @@ class EQeqC final: public EEMethod {
     [[nodiscard]] Eigen::VectorXd EE_system(const std::vector<const Atom *> &atoms, double total_charge) const;
 
 public:
-    explicit EQeqC() : EEMethod({"alpha"}, {"Dz"}, {}, {}) {}
+    explicit EQeqC() : EEMethod({"alpha"}, {"Dz"}, {},
+            {
+                {"correction_cutoff", {"correction_cutoff", "Cutoff for the bond-order correction (0 uses all pairs)",
+                                       "double", "10", {}}}
+            }) {}
 
     [[nodiscard]] const MethodMetadata& metadata() const override {
         return METADATA;
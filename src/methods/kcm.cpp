@@ -1,6 +1,9 @@
 #include <vector>
 #include <cmath>
-#include <Eigen/LU>
+#include <limits>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseLU>
 
 #include "kcm.h"
 #include "../structures/molecule.h"
@@ -16,30 +19,56 @@ std::vector<double> KCM::calculate_charges(const Molecule &molecule) const {
     const auto n = static_cast<Eigen::Index>(molecule.atoms().size());
     const auto m = static_cast<Eigen::Index>(molecule.bonds().size());
 
-    Eigen::MatrixXd W = Eigen::MatrixXd::Zero(m, m);
-    Eigen::MatrixXd B = Eigen::MatrixXd::Zero(m, n);
     Eigen::VectorXd chi0 = Eigen::VectorXd::Zero(n);
 
     /* Compute
      *  q = (B.T @ W @ B + I)^-1 @ chi0 - chi0
+     * B.T @ W @ B is a graph Laplacian weighted by the diagonal of W, so it is assembled directly from the bonds
      */
 
     for (Eigen::Index i = 0; i < n; i++) {
         chi0(i) = parameters_->atom()->parameter(atom::electronegativity)(molecule.atoms()[i]);
     }
 
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.reserve(n + 4 * m);
+
+    for (Eigen::Index i = 0; i < n; i++) {
+        triplets.emplace_back(i, i, 1.0);
+    }
+
     for (Eigen::Index i = 0; i < m; i++) {
         auto &bond = molecule.bonds()[i];
         auto &first = bond.first();
         auto &second = bond.second();
 
-        W(i, i) = 1 / (parameters_->atom()->parameter(atom::hardness)(first) +
-                            parameters_->atom()->parameter(atom::hardness)(second));
+        double w = 1 / (parameters_->atom()->parameter(atom::hardness)(first) +
+                        parameters_->atom()->parameter(atom::hardness)(second));
+
+        auto i1 = static_cast<Eigen::Index>(first.index());
+        auto i2 = static_cast<Eigen::Index>(second.index());
+        triplets.emplace_back(i1, i1, w);
+        triplets.emplace_back(i2, i2, w);
+        triplets.emplace_back(i1, i2, -w);
+        triplets.emplace_back(i2, i1, -w);
+    }
+
+    Eigen::SparseMatrix<double> K(n, n);
+    K.setFromTriplets(triplets.begin(), triplets.end());
 
-        B(i, static_cast<Eigen::Index>(first.index())) = 1;
-        B(i, static_cast<Eigen::Index>(second.index())) = -1;
+    /* The matrix is positive definite for positive hardness; other parameters fall back to the LU decomposition */
+    Eigen::VectorXd q;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt(K);
+    if (ldlt.info() == Eigen::Success and (ldlt.vectorD().array() > 0).all()) {
+        q = ldlt.solve(chi0);
+    } else {
+        Eigen::SparseLU<Eigen::SparseMatrix<double>> lu(K);
+        if (lu.info() != Eigen::Success) {
+            return std::vector<double>(n, std::numeric_limits<double>::quiet_NaN());
+        }
+        q = lu.solve(chi0);
     }
 
-    Eigen::VectorXd q = (B.transpose() * W * B + Eigen::MatrixXd::Identity(n, n)).partialPivLu().solve(chi0) - chi0;
+    q -= chi0;
     return {q.data(), q.data() + q.size()};
 }
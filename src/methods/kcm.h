@@ -25,6 +25,4 @@ public:
     }
     
     [[nodiscard]] std::vector<double> calculate_charges(const Molecule &molecule) const override;
-
-    [[nodiscard]] bool is_suitable_for_large_molecule() const override { return false; }
 };
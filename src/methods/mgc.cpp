@@ -1,6 +1,9 @@
 #include <vector>
 #include <cmath>
-#include <Eigen/LU>
+#include <limits>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseLU>
 
 #include "mgc.h"
 #include "../structures/molecule.h"
@@ -14,14 +17,15 @@ std::vector<double> MGC::calculate_charges(const Molecule &molecule) const {
 
     const auto n = static_cast<Eigen::Index>(molecule.atoms().size());
 
-    Eigen::MatrixXd S = Eigen::MatrixXd::Zero(n, n);
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.reserve(n + 4 * molecule.bonds().size());
     Eigen::VectorXd X0 = Eigen::VectorXd::Zero(n);
 
     double log_sum = 0;
 
     for (const auto &atom: molecule.atoms()) {
         auto i = static_cast<Eigen::Index>(atom.index());
-        S(i, i) = 1;
+        triplets.emplace_back(i, i, 1.0);
         X0(i) = atom.element().electronegativity();
         log_sum += log(X0(i));
     }
@@ -29,14 +33,29 @@ std::vector<double> MGC::calculate_charges(const Molecule &molecule) const {
     for (const auto &bond: molecule.bonds()) {
         auto i1 = static_cast<Eigen::Index>(bond.first().index());
         auto i2 = static_cast<Eigen::Index>(bond.second().index());
-        auto order = bond.order();
-        S(i1, i1) += order;
-        S(i2, i2) += order;
-        S(i1, i2) -= order;
-        S(i2, i1) -= order;
+        auto order = static_cast<double>(bond.order());
+        triplets.emplace_back(i1, i1, order);
+        triplets.emplace_back(i2, i2, order);
+        triplets.emplace_back(i1, i2, -order);
+        triplets.emplace_back(i2, i1, -order);
+    }
+
+    Eigen::SparseMatrix<double> S(n, n);
+    S.setFromTriplets(triplets.begin(), triplets.end());
+
+    /* Identity plus a Laplacian weighted by the (positive) bond orders is positive definite */
+    Eigen::VectorXd chi;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt(S);
+    if (ldlt.info() == Eigen::Success) {
+        chi = ldlt.solve(X0);
+    } else {
+        Eigen::SparseLU<Eigen::SparseMatrix<double>> lu(S);
+        if (lu.info() != Eigen::Success) {
+            return std::vector<double>(n, std::numeric_limits<double>::quiet_NaN());
+        }
+        chi = lu.solve(X0);
     }
 
-    Eigen::VectorXd chi = S.partialPivLu().solve(X0);
     for (Eigen::Index i = 0; i < n; i++) {
         chi(i) -= molecule.atoms()[i].element().electronegativity();
     }
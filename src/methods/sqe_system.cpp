@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <Eigen/LU>
+
+#include "sqe_system.h"
+#include "../ee_method.h"
+#include "../geometry.h"
+
+
+SQESystem::SQESystem(const std::vector<const Atom *> &atoms, const std::vector<FragmentBond> &bonds,
+                     Eigen::VectorXd hardness, Eigen::VectorXd width, Eigen::VectorXd kappa) :
+        atoms_{atoms},
+        bonds_{bonds},
+        hardness_{std::move(hardness)},
+        width_{std::move(width)},
+        kappa_{std::move(kappa)} {}
+
+
+double SQESystem::kernel(Eigen::Index i, Eigen::Index j) const {
+    if (i == j) {
+        return hardness_(i);
+    }
+
+    auto d = distance(*atoms_[i], *atoms_[j]);
+    auto d0 = sqrt(2 * width_(i) * width_(i) + 2 * width_(j) * width_(j));
+    return erf(d / d0) / d;
+}
+
+
+double SQESystem::bond_entry(Eigen::Index k, Eigen::Index l) const {
+    auto k1 = static_cast<Eigen::Index>(bonds_[k].first);
+    auto k2 = static_cast<Eigen::Index>(bonds_[k].second);
+    auto l1 = static_cast<Eigen::Index>(bonds_[l].first);
+    auto l2 = static_cast<Eigen::Index>(bonds_[l].second);
+
+    double value = kernel(k1, l1) - kernel(k1, l2) - kernel(k2, l1) + kernel(k2, l2);
+    if (k == l) {
+        value += kappa_(k);
+    }
+    return value;
+}
+
+
+Eigen::VectorXd SQESystem::atom_product(const Eigen::VectorXd &x) const {
+    const auto n = static_cast<Eigen::Index>(atoms_.size());
+    Eigen::VectorXd y = Eigen::VectorXd::Zero(n);
+
+#pragma omp parallel for schedule(dynamic, 64) default(none) shared(x, y) firstprivate(n)
+    for (Eigen::Index i = 0; i < n; i++) {
+        double sum = 0;
+        for (Eigen::Index j = 0; j < n; j++) {
+            sum += kernel(i, j) * x(j);
+        }
+        y(i) = sum;
+    }
+
+    return y;
+}
+
+
+Eigen::VectorXd SQESystem::solve_dense(const Eigen::VectorXd &split_b) const {
+    /* Bonds of a block share most of their atoms, whose kernel rows are evaluated once for the whole block */
+    constexpr Eigen::Index BLOCK = 16;
+
+    const auto n = static_cast<Eigen::Index>(atoms_.size());
+    const auto m = static_cast<Eigen::Index>(bonds_.size());
+    const Eigen::Index blocks = (m + BLOCK - 1) / BLOCK;
+    Eigen::MatrixXd split_A(m, m);
+
+#pragma omp parallel for schedule(dynamic, 1) default(none) shared(split_A) firstprivate(n, m, blocks)
+    for (Eigen::Index block = 0; block < blocks; block++) {
+        const Eigen::Index begin = block * BLOCK;
+        const Eigen::Index end = std::min(m, begin + BLOCK);
+
+        std::vector<Eigen::Index> block_atoms;
+        for (Eigen::Index k = begin; k < end; k++) {
+            for (const auto atom: {bonds_[k].first, bonds_[k].second}) {
+                if (std::ranges::find(block_atoms, static_cast<Eigen::Index>(atom)) == block_atoms.end()) {
+                    block_atoms.push_back(static_cast<Eigen::Index>(atom));
+                }
+            }
+        }
+
+        Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> rows(
+                static_cast<Eigen::Index>(block_atoms.size()), n);
+        for (Eigen::Index r = 0; r < rows.rows(); r++) {
+            for (Eigen::Index j = 0; j < n; j++) {
+                rows(r, j) = kernel(block_atoms[r], j);
+            }
+        }
+
+        auto row_of = [&block_atoms](size_t atom) {
+            return static_cast<Eigen::Index>(std::ranges::find(block_atoms, static_cast<Eigen::Index>(atom)) -
+                                             block_atoms.begin());
+        };
+
+        for (Eigen::Index k = begin; k < end; k++) {
+            const auto r1 = row_of(bonds_[k].first);
+            const auto r2 = row_of(bonds_[k].second);
+            for (Eigen::Index l = 0; l < m; l++) {
+                const auto l1 = static_cast<Eigen::Index>(bonds_[l].first);
+                const auto l2 = static_cast<Eigen::Index>(bonds_[l].second);
+                split_A(k, l) = rows(r1, l1) - rows(r1, l2) - rows(r2, l1) + rows(r2, l2);
+            }
+            split_A(k, k) += kappa_(k);
+        }
+    }
+
+    return split_A.partialPivLu().solve(split_b);
+}
+
+
+Eigen::VectorXd SQESystem::solve_iterative(const Eigen::VectorXd &split_b) const {
+    constexpr int MAX_ITERATIONS = 1000;
+    constexpr double TOLERANCE = 1e-10;
+    /* The recurrence drifts from the true residual, which is therefore accepted with a looser bound */
+    constexpr double FINAL_TOLERANCE = 1e-8;
+
+    const auto n = static_cast<Eigen::Index>(atoms_.size());
+    const auto m = static_cast<Eigen::Index>(bonds_.size());
+
+    /* (T * A * T^T + diag(kappa)) * s evaluated through the atoms */
+    auto product = [this, n, m](const Eigen::VectorXd &s) {
+        Eigen::VectorXd atom_s = Eigen::VectorXd::Zero(n);
+        for (Eigen::Index k = 0; k < m; k++) {
+            atom_s(static_cast<Eigen::Index>(bonds_[k].first)) += s(k);
+            atom_s(static_cast<Eigen::Index>(bonds_[k].second)) -= s(k);
+        }
+
+        const Eigen::VectorXd atom_y = atom_product(atom_s);
+        Eigen::VectorXd y = kappa_.cwiseProduct(s);
+        for (Eigen::Index k = 0; k < m; k++) {
+            y(k) += atom_y(static_cast<Eigen::Index>(bonds_[k].first)) -
+                    atom_y(static_cast<Eigen::Index>(bonds_[k].second));
+        }
+        return y;
+    };
+
+    Eigen::VectorXd diagonal(m);
+    for (Eigen::Index k = 0; k < m; k++) {
+        diagonal(k) = bond_entry(k, k);
+    }
+
+    /* Conjugate gradients with the Jacobi preconditioner */
+    Eigen::VectorXd s = Eigen::VectorXd::Zero(m);
+    Eigen::VectorXd r = split_b;
+    Eigen::VectorXd z = r.cwiseQuotient(diagonal);
+    Eigen::VectorXd p = z;
+    double rz = r.dot(z);
+    const double threshold = TOLERANCE * split_b.norm();
+
+    for (int iteration = 0; iteration < MAX_ITERATIONS and r.norm() > threshold; iteration++) {
+        const Eigen::VectorXd Ap = product(p);
+        const double alpha = rz / p.dot(Ap);
+        s += alpha * p;
+        r -= alpha * Ap;
+        z = r.cwiseQuotient(diagonal);
+        const double rz_next = r.dot(z);
+        p = z + (rz_next / rz) * p;
+        rz = rz_next;
+    }
+
+    /* Charges of a system that did not converge are reported as numerically incorrect by the caller */
+    if (not ((split_b - product(s)).norm() <= FINAL_TOLERANCE * split_b.norm())) {
+        return Eigen::VectorXd::Constant(m, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    return s;
+}
+
+
+Eigen::VectorXd SQESystem::solve(const Eigen::VectorXd &b) const {
+    const auto m = static_cast<Eigen::Index>(bonds_.size());
+
+    Eigen::VectorXd split_b(m);
+    for (Eigen::Index k = 0; k < m; k++) {
+        split_b(k) = b(static_cast<Eigen::Index>(bonds_[k].first)) - b(static_cast<Eigen::Index>(bonds_[k].second));
+    }
+
+    if (m == 0) {
+        return split_b;
+    }
+
+    /* The dense matrix and its LU decomposition */
+    const double dense_memory = 2.0 * sizeof(double) * static_cast<double>(m) * static_cast<double>(m);
+    return dense_memory <= available_solver_memory() ? solve_dense(split_b) : solve_iterative(split_b);
+}
+
+
+Eigen::VectorXd sqe_split_charges(const Parameters &parameters, const std::vector<const Atom *> &atoms,
+                                  const std::vector<FragmentBond> &bonds, const Eigen::VectorXd *initial) {
+    enum atom{electronegativity, hardness, width};
+    enum bond{kappa};
+
+    const auto n = static_cast<Eigen::Index>(atoms.size());
+    const auto m = static_cast<Eigen::Index>(bonds.size());
+
+    Eigen::VectorXd hardness_values = Eigen::VectorXd::Zero(n);
+    Eigen::VectorXd width_values = Eigen::VectorXd::Zero(n);
+    Eigen::VectorXd kappa_values = Eigen::VectorXd::Zero(m);
+    Eigen::VectorXd b = Eigen::VectorXd::Zero(n);
+
+    for (Eigen::Index i = 0; i < n; i++) {
+        const auto &atom = *atoms[i];
+        hardness_values(i) = parameters.atom()->parameter(hardness)(atom);
+        width_values(i) = parameters.atom()->parameter(width)(atom);
+        b(i) = -parameters.atom()->parameter(electronegativity)(atom);
+    }
+
+    for (Eigen::Index i = 0; i < m; i++) {
+        kappa_values(i) = parameters.bond()->parameter(kappa)(*bonds[i].bond);
+    }
+
+    SQESystem system(atoms, bonds, hardness_values, std::move(width_values), std::move(kappa_values));
+
+    if (initial != nullptr) {
+        Eigen::VectorXd q0(n);
+        for (Eigen::Index i = 0; i < n; i++) {
+            q0(i) = (*initial)(static_cast<Eigen::Index>(atoms[i]->index()));
+        }
+
+        /* Only the interactions with the other atoms shift the electronegativity of the initial charges */
+        b = b - system.atom_product(q0);
+        b = b + hardness_values.cwiseProduct(q0);
+    }
+
+    return system.solve(b);
+}
+
+
+Eigen::VectorXd split_to_atom_charges(const Molecule &molecule, const Eigen::VectorXd &split) {
+    Eigen::VectorXd q = Eigen::VectorXd::Zero(static_cast<Eigen::Index>(molecule.atoms().size()));
+    for (size_t k = 0; k < molecule.bonds().size(); k++) {
+        const auto &bond = molecule.bonds()[k];
+        const auto s = split(static_cast<Eigen::Index>(k));
+        q(static_cast<Eigen::Index>(bond.first().index())) += s;
+        q(static_cast<Eigen::Index>(bond.second().index())) -= s;
+    }
+
+    return q;
+}
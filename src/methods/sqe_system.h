@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <Eigen/Core>
+
+#include "../ee_method.h"
+#include "../parameters.h"
+#include "../structures/molecule.h"
+
+
+/* Split-charge equilibration system of a molecule or its fragment shared by SQE, SQE+qp and SQE+q0. Atoms interact
+ * through their hardness (diagonal) and a Gaussian-screened Coulomb kernel erf(d / d0) / d, bonds add their kappa to
+ * the bond-space diagonal. The atom matrix A is never stored; its entries are evaluated when needed */
+class SQESystem {
+    const std::vector<const Atom *> &atoms_;
+    const std::vector<FragmentBond> &bonds_;
+    Eigen::VectorXd hardness_;
+    Eigen::VectorXd width_;
+    Eigen::VectorXd kappa_;
+
+    [[nodiscard]] double kernel(Eigen::Index i, Eigen::Index j) const;
+
+    /* Entry (k, l) of T * A * T^T + diag(kappa) for the bond-atom incidence matrix T */
+    [[nodiscard]] double bond_entry(Eigen::Index k, Eigen::Index l) const;
+
+    [[nodiscard]] Eigen::VectorXd solve_dense(const Eigen::VectorXd &split_b) const;
+
+    [[nodiscard]] Eigen::VectorXd solve_iterative(const Eigen::VectorXd &split_b) const;
+
+public:
+    SQESystem(const std::vector<const Atom *> &atoms, const std::vector<FragmentBond> &bonds, Eigen::VectorXd hardness,
+              Eigen::VectorXd width, Eigen::VectorXd kappa);
+
+    /* Product A * x */
+    [[nodiscard]] Eigen::VectorXd atom_product(const Eigen::VectorXd &x) const;
+
+    /* Split charges s solving (T * A * T^T + diag(kappa)) * s = T * b. The bond-space matrix is assembled directly if
+     * it fits into the available memory, otherwise it is solved by preconditioned conjugate gradients with matrix-free
+     * products; if those do not converge, all split charges are NaN */
+    [[nodiscard]] Eigen::VectorXd solve(const Eigen::VectorXd &b) const;
+};
+
+
+/* Split charges of the fragment bonds for SQE, SQE+qp and SQE+q0, whose leading parameters are the same (electronegativity,
+ * hardness and width of atoms, kappa of bonds). With initial charges of all atoms of the molecule, the atoms start from
+ * them, so only the interactions of the initial charges with the other atoms shift the electronegativity */
+[[nodiscard]] Eigen::VectorXd sqe_split_charges(const Parameters &parameters, const std::vector<const Atom *> &atoms,
+                                                const std::vector<FragmentBond> &bonds,
+                                                const Eigen::VectorXd *initial = nullptr);
+
+
+/* Atomic charges T^T * s of the molecule with split charges s of its bonds */
+[[nodiscard]] Eigen::VectorXd split_to_atom_charges(const Molecule &molecule, const Eigen::VectorXd &split);
@@ -1,11 +1,9 @@
 #include <vector>
-#include <cmath>
-#include <Eigen/LU>
-#include <Eigen/Sparse>
+#include <Eigen/Core>
 
 #include "sqeq0.h"
+#include "sqe_system.h"
 #include "../parameters.h"
-#include "../geometry.h"
 #include "../method_registry.h"
 
 
@@ -15,63 +13,17 @@
 std::vector<double> SQEq0::calculate_charges(const Molecule &molecule) const {
 
     const auto n = static_cast<Eigen::Index>(molecule.atoms().size());
-    const auto m = static_cast<Eigen::Index>(molecule.bonds().size());
 
     Eigen::VectorXd q0 = Eigen::VectorXd::Zero(n);
-    Eigen::VectorXd hardness = Eigen::VectorXd::Zero(n);
-
     for (Eigen::Index i = 0; i < n; i++) {
         const auto &atom = molecule.atoms()[i];
         q0(i) = atom.formal_charge();
-        hardness(i) = parameters_->atom()->parameter(atom::hardness)(atom);
-    }
-
-    Eigen::SparseMatrix<double> T(m, n);
-    std::vector<Eigen::Triplet<double>> triplets;
-    triplets.reserve(2 * m);
-
-    for (Eigen::Index i = 0; i < static_cast<Eigen::Index>(molecule.bonds().size()); i++) {
-        const auto &bond = molecule.bonds()[i];
-        auto i1 = static_cast<Eigen::Index>(bond.first().index());
-        auto i2 = static_cast<Eigen::Index>(bond.second().index());
-        triplets.emplace_back(i, i1, 1.0);
-        triplets.emplace_back(i, i2, -1.0);
-    }
-    T.setFromTriplets(triplets.begin(), triplets.end());
-
-    Eigen::MatrixXd A = Eigen::MatrixXd::Zero(n, n);
-    Eigen::VectorXd b = Eigen::VectorXd::Zero(n);
-
-    /* Setup EEM part */
-    for (Eigen::Index i = 0; i < n; i++) {
-        const auto &atom_i = molecule.atoms()[i];
-        A(i, i) = hardness(i);
-        b(i) = -parameters_->atom()->parameter(atom::electronegativity)(atom_i);
-        for (Eigen::Index j = i + 1; j < n; j++) {
-            const auto &atom_j = molecule.atoms()[j];
-            auto d = distance(atom_i, atom_j);
-            auto wi = parameters_->atom()->parameter(atom::width)(atom_i);
-            auto wj = parameters_->atom()->parameter(atom::width)(atom_j);
-            auto d0 = sqrt(2 * wi * wi + 2 * wj * wj);
-            auto x = erf(d / d0) / d;
-            A(i, j) = x;
-            A(j, i) = x;
-        }
-    }
-
-    b = b - A * q0;
-    b = b + hardness.cwiseProduct(q0);
-
-    Eigen::MatrixXd split_A = T * A * T.transpose();
-    Eigen::VectorXd split_b = T * b;
-
-    for (Eigen::Index i = 0; i < static_cast<Eigen::Index>(molecule.bonds().size()); i++) {
-        const auto &bond = molecule.bonds()[i];
-        split_A(i, i) += parameters_->bond()->parameter(bond::kappa)(bond);
     }
 
-    Eigen::VectorXd split_q = split_A.partialPivLu().solve(split_b);
-    Eigen::VectorXd q = T.transpose() * split_q + q0;
+    auto f = [this, &q0](const std::vector<const Atom *> &atoms, const std::vector<FragmentBond> &bonds) {
+        return sqe_split_charges(*parameters_, atoms, bonds, &q0);
+    };
 
-    return {q.data(), q.data() + n};
+    Eigen::VectorXd q = split_to_atom_charges(molecule, solve_split_EE(molecule, f)) + q0;
+    return {q.data(), q.data() + q.size()};
 }
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <Eigen/Core>
 #include <vector>
 
 #include "../structures/molecule.h"
 #include "../method.h"
+#include "../ee_method.h"
 
 
-class SQEqp final: public Method {
+class SQEqp final: public EEMethod {
     inline static const MethodMetadata METADATA = {
         .name = "SQE+qp",
         .internal_name = "sqeqp",
@@ -20,7 +22,7 @@ class SQEqp final: public Method {
     enum bond{kappa};
 
 public:
-    explicit SQEqp() : Method({}, {"electronegativity", "hardness", "width", "q0"}, {"kappa"}, {}) {}
+    explicit SQEqp() : EEMethod({}, {"electronegativity", "hardness", "width", "q0"}, {"kappa"}, {}) {}
 
     [[nodiscard]] const MethodMetadata& metadata() const override {
         return METADATA;
@@ -28,5 +30,12 @@ public:
 
     [[nodiscard]] std::vector<double> calculate_charges(const Molecule &molecule) const override;
 
-    [[nodiscard]] bool is_suitable_for_large_molecule() const override { return false; }
+    [[nodiscard]] bool uses_split_charges() const override {
+        return true;
+    }
+
+    /* Split charges of bonds, without a constraint */
+    [[nodiscard]] size_t system_size([[maybe_unused]] size_t atoms, size_t bonds) const override {
+        return bonds;
+    }
 };
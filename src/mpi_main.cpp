@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <print>
+#include <mpi.h>
+
+#include "chargefw2.h"
+#include "candidates.h"
+#include "config.h"
+#include "distributed.h"
+#include "ee_method.h"
+#include "executor.h"
+#include "method.h"
+#include "options.h"
+#include "parameters.h"
+#include "formats/fw2bin.h"
+#include "formats/reader.h"
+#include "formats/save_charges.h"
+#include "structures/molecule_set.h"
+#include "utility/exceptions.h"
+#include "utility/install.h"
+
+
+/* Every process loads the input and sets up the method on its own; only rank 0 prints and writes the output */
+static void run(int rank, const boost::program_options::parsed_options &parsed) {
+    if (config::mode != "charges") {
+        throw ParameterException("Only the charges mode can be distributed");
+    }
+    if (config::method_name.empty() or config::method_name.find(',') != std::string::npos) {
+        throw ParameterException("A single method has to be selected");
+    }
+    if (config::checkpoint or not config::result_cache.empty()) {
+        throw ParameterException("Checkpoints and result cache are not available in distributed runs");
+    }
+
+    MoleculeSet m;
+    if (config::cache_file.empty()) {
+        m = load_molecule_set(config::input_file);
+    } else {
+        /* The binary cache is created by rank 0 before the others read it */
+        if (rank == 0) {
+            m = load_molecule_set_cached(config::input_file, config::cache_file);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank != 0) {
+            m = load_molecule_set_cached(config::input_file, config::cache_file);
+        }
+    }
+
+    if (m.molecules().empty()) {
+        throw FileException("No molecules were loaded from the input file");
+    }
+
+    auto method = load_method(config::method_name);
+    setup_method_options(*method, parsed);
+
+    std::unique_ptr<Parameters> p;
+    if (method->has_parameters()) {
+        if (config::par_file.empty()) {
+            auto best_par = best_parameters(m, *method, m.has_proteins(), config::permissive_types);
+            if (not best_par.has_value()) {
+                throw ParameterException("No parameters found");
+            }
+            p = std::move(best_par.value());
+        } else {
+            p = std::make_unique<Parameters>(InstallPaths::parametersdir() / (config::par_file + ".json"));
+        }
+
+        size_t unclassified = m.classify_set_from_parameters(*p, true, config::permissive_types);
+        if (rank == 0) {
+            std::println("Method: {}", method->metadata().name);
+            std::println("Parameters: {}", p->name());
+            std::println("Number of unclassified molecules: {}", unclassified);
+        }
+        method->set_parameters(p.get());
+    } else {
+        m.classify_atoms(AtomClassifier::PLAIN);
+        if (rank == 0) {
+            std::println("Method: {}", method->metadata().name);
+        }
+    }
+
+    m.fulfill_requirements(method->get_requirements());
+
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    if (rank != 0) {
+        calculate_charges_distributed(*method, m, [](size_t, std::vector<double>) {});
+        return;
+    }
+
+    std::println("Processes: {}; Molecules: {}", size, m.molecules().size());
+
+    ChargesOutput output(m, method->metadata().name, p ? p->name() : "None", config::input_file);
+    calculate_charges_distributed(*method, m, [&m, &output](size_t i, std::vector<double> results) {
+        if (std::ranges::any_of(results, [](double chg) noexcept { return not std::isfinite(chg); })) {
+            std::println(stderr, "Cannot compute charges for {}: Method returned numerically incorrect values",
+                         m.molecules()[i].name());
+            output.skip(i);
+            return;
+        }
+        output.submit(i, std::move(results));
+    });
+    output.finish();
+
+    FragmentStatistics::global().print(stdout);
+}
+
+
+/* Each process may use several threads, but MPI is called only from the main one */
+int main(int argc, char **argv) {
+    int provided = 0;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    auto parsed = parse_args(argc, argv);
+    check_common_args();
+    set_thread_count(config::threads);
+
+    /* A failure of any process would leave the others waiting for it */
+    int exit_code = to_int(ExitCode::Success);
+    try {
+        run(rank, parsed);
+    } catch (FileException &e) {
+        std::println(stderr, "{}", e.what());
+        exit_code = to_int(ExitCode::FileError);
+    } catch (ParameterException &e) {
+        std::println(stderr, "{}", e.what());
+        exit_code = to_int(ExitCode::ParameterError);
+    } catch (std::exception &e) {
+        std::println(stderr, "{}", e.what());
+        exit_code = to_int(ExitCode::InternalError);
+    }
+
+    if (exit_code != to_int(ExitCode::Success)) {
+        MPI_Abort(MPI_COMM_WORLD, exit_code);
+    }
+
+    MPI_Finalize();
+    return exit_code;
+}
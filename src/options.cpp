@@ -1,9 +1,12 @@
 #include <boost/program_options.hpp>
 #include <print>
+#include <stdexcept>
+#include <string>
 
 #include "chargefw2.h"
 #include "config.h"
 #include "options.h"
+#include "utility/strings.h"
 
 
 template <class T>
@@ -14,6 +17,30 @@ std::string streamed(const T& x) {
 }
 
 
+/* Amount of memory in megabytes or with a K, M, G or T suffix */
+static size_t parse_memory(const std::string &text) {
+    size_t pos = 0;
+    const double value = std::stod(text, &pos);
+    const std::string suffix = to_uppercase(text.substr(pos));
+
+    double unit = 1024.0 * 1024.0;
+    if (suffix == "K") {
+        unit = 1024.0;
+    } else if (suffix == "G") {
+        unit = 1024.0 * 1024.0 * 1024.0;
+    } else if (suffix == "T") {
+        unit = 1024.0 * 1024.0 * 1024.0 * 1024.0;
+    } else if (not suffix.empty() and suffix != "M") {
+        throw std::invalid_argument("Unknown memory unit: " + suffix);
+    }
+
+    if (value < 0) {
+        throw std::invalid_argument("Memory must not be negative");
+    }
+    return static_cast<size_t>(value * unit);
+}
+
+
 boost::program_options::parsed_options parse_args(int argc, char **argv) {
     namespace po = boost::program_options;
 
@@ -21,12 +48,24 @@ boost::program_options::parsed_options parse_args(int argc, char **argv) {
     desc.add_options()
             ("help", "Prints this help")
             ("mode", po::value<std::string>()->required(), "Mode")
-            ("input-file", po::value<std::string>()->default_value(""), "Input file")
+            ("input-file", po::value<std::string>()->default_value(""), "Input file (a directory or a glob pattern in batch mode)")
+            ("input-list", po::value<std::string>()->default_value(""), "File listing input files, one per line (batch mode)")
             ("par-file", po::value<std::string>()->default_value(""), "File with parameters (json)")
             ("chg-out-dir", po::value<std::string>()->default_value(""), "Directory to output charges to")
             ("log-file", po::value<std::string>()->default_value(""), "Log file")
+            ("threads", po::value<int>()->default_value(0), "Number of threads (0 uses all cores)")
+            ("max-memory", po::value<std::string>()->default_value("0"), "Memory for solving the equalization systems, e.g. 512M or 16G (0 uses 3/4 of the physical memory)")
+            ("accuracy", po::value<std::string>()->default_value("medium"), "Solver modes chosen automatically: high (full), medium (full, cutoff), low (full, cutoff, cover)")
+            ("cache", po::value<std::string>()->default_value(""), "Binary cache of the loaded input (fw2bin), reused if up to date")
+            ("result-cache", po::value<std::string>()->default_value(""), "File with charges computed by previous runs, new results are added")
+            ("socket", po::value<std::string>()->default_value(""), "Unix socket to accept jobs on (serve mode)")
+            ("output-formats", po::value<std::string>()->default_value(""), "Comma-separated list of output formats (txt, cif, pqr, mol2, npz)")
+            ("output-compression", po::value<std::string>()->default_value("none"), "Compress output files (none, gzip, zstd)")
+            ("merge-cif-output", po::bool_switch()->default_value(false), "Write mmCIF output of all molecules into a single file")
             ("read-hetatm", po::bool_switch()->default_value(false), "Read HETATM records from PDB/mmCIF files")
             ("ignore-water", po::bool_switch()->default_value(false), "Discard water molecules from PDB/mmCIF files")
+            ("checkpoint", po::bool_switch()->default_value(false), "Record finished molecules in the output directory so that an interrupted run can be resumed")
+            ("resume", po::bool_switch()->default_value(false), "Skip molecules finished by an interrupted run (implies --checkpoint)")
             ("permissive-types", po::bool_switch()->default_value(false), "Use similar parameters for similar atom/bond types if no exact match is found")
             ("method", po::value<std::string>()->default_value(""), "Method");
 
@@ -49,13 +88,25 @@ boost::program_options::parsed_options parse_args(int argc, char **argv) {
 
         config::mode = vm["mode"].as<std::string>();
         config::input_file = vm["input-file"].as<std::string>();
+        config::input_list = vm["input-list"].as<std::string>();
         config::par_file = vm["par-file"].as<std::string>();
         config::chg_out_dir = vm["chg-out-dir"].as<std::string>();
         config::log_file = vm["log-file"].as<std::string>();
+        config::output_compression = vm["output-compression"].as<std::string>();
+        config::cache_file = vm["cache"].as<std::string>();
+        config::result_cache = vm["result-cache"].as<std::string>();
+        config::socket_path = vm["socket"].as<std::string>();
+        config::threads = vm["threads"].as<int>();
+        config::max_memory = parse_memory(vm["max-memory"].as<std::string>());
+        config::accuracy = vm["accuracy"].as<std::string>();
+        config::output_formats = split(vm["output-formats"].as<std::string>(), ',');
         config::method_name = vm["method"].as<std::string>();
         config::read_hetatm = vm["read-hetatm"].as<bool>();
         config::ignore_water = vm["ignore-water"].as<bool>();
         config::permissive_types = vm["permissive-types"].as<bool>();
+        config::resume = vm["resume"].as<bool>();
+        config::checkpoint = vm["checkpoint"].as<bool>() or config::resume;
+        config::merge_cif_output = vm["merge-cif-output"].as<bool>();
 
         return parsed;
     } catch (const std::exception &e) {
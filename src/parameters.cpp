@@ -2,6 +2,7 @@
 #include <fstream>
 #include <string>
 #include <print>
+#include <tuple>
 #include <vector>
 #include <nlohmann/json.hpp>
 
@@ -109,6 +110,50 @@ void Parameters::print() const {
 }
 
 
+Hasher::Digest Parameters::digest() const {
+    Hasher hasher;
+    hasher.add(method_name_);
+
+    auto add_names = [&hasher](const std::string &section, const std::vector<std::string> &names) {
+        hasher.add(section);
+        hasher.add(static_cast<uint64_t>(names.size()));
+        for (const auto &name: names) {
+            hasher.add(name);
+        }
+    };
+    auto add_values = [&hasher](const std::vector<double> &values) {
+        hasher.add(static_cast<uint64_t>(values.size()));
+        for (double value: values) {
+            hasher.add(value);
+        }
+    };
+    auto add_key = [&hasher](const auto &key) {
+        std::apply([&hasher](const auto &...parts) { (hasher.add(parts), ...); }, key);
+    };
+
+    if (common_) {
+        add_names("common", common_->names_);
+        add_values(common_->parameters_);
+    }
+    if (atoms_) {
+        add_names("atom", atoms_->names_);
+        for (size_t i = 0; i < atoms_->parameters_.size(); i++) {
+            add_key(atoms_->keys_[i]);
+            add_values(atoms_->parameters_[i]);
+        }
+    }
+    if (bonds_) {
+        add_names("bond", bonds_->names_);
+        for (size_t i = 0; i < bonds_->parameters_.size(); i++) {
+            add_key(bonds_->keys_[i]);
+            add_values(bonds_->parameters_[i]);
+        }
+    }
+
+    return hasher.digest();
+}
+
+
 std::function<double(const Atom &)> AtomParameters::parameter(size_t idx) const noexcept {
 
     return [this, idx](const Atom &atom) noexcept { return parameters_[atom.type()][idx]; };
@@ -9,6 +9,7 @@
 
 #include "structures/atom.h"
 #include "structures/bond.h"
+#include "utility/hasher.h"
 
 
 struct ParametersMetadata {
@@ -110,4 +111,7 @@ public:
     [[nodiscard]] const AtomParameters *atom() const { return atoms_.get(); }
 
     [[nodiscard]] const BondParameters *bond() const { return bonds_.get(); }
+
+    /* Hash of all parameter values together with their names and keys, the set is identified by it */
+    [[nodiscard]] Hasher::Digest digest() const;
 };
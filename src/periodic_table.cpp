@@ -1,5 +1,6 @@
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <filesystem>
 #include <stdexcept>
@@ -63,15 +64,16 @@ const PeriodicTable &PeriodicTable::pte() {
 }
 
 
-const Element *PeriodicTable::get_element_by_symbol(const std::string &symbol) const {
+const Element *PeriodicTable::get_element_by_symbol(std::string_view symbol) const {
     /* Treat deuterium as hydrogen */
     if (symbol == "D") {
         return get_element_by_Z(0);
     }
 
-    if (!symbol_Z_.contains(symbol)) {
+    auto it = symbol_Z_.find(symbol);
+    if (it == symbol_Z_.end()) {
         throw std::runtime_error(std::format("No such element: {}", symbol));
     }
-    return get_element_by_Z(symbol_Z_.at(symbol) - 1);
+    return get_element_by_Z(it->second - 1);
 }
 
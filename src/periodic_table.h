@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 
@@ -9,13 +10,15 @@
 
 class PeriodicTable {
     std::vector<Element> elements_;
-    std::map<std::string, size_t> symbol_Z_;
+    std::map<std::string, size_t, std::less<>> symbol_Z_;
 public:
     static const PeriodicTable &pte();
 
     [[nodiscard]] const Element *get_element_by_Z(size_t Z) const { return &elements_[Z]; }
 
-    [[nodiscard]] const Element *get_element_by_symbol(const std::string &symbol) const;
+    [[nodiscard]] const Element *get_element_by_symbol(std::string_view symbol) const;
+
+    [[nodiscard]] size_t size() const { return elements_.size(); }
 
     PeriodicTable();
 };
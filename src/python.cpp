@@ -12,6 +12,7 @@
 #include "charges.h"
 #include "formats/save_charges.h"
 #include "method.h"
+#include "executor.h"
 #include "parameters.h"
 #include "structures/molecule_set.h"
 #include "formats/reader.h"
@@ -34,9 +35,9 @@ static std::vector<std::unique_ptr<Method>>& methods_pool() {
 
 
 std::map<std::string, std::vector<double>>
-calculate_charges(struct Molecules &molecules, const std::string &method_name, std::optional<const std::string> &parameters_name, std::optional<const std::string> &chg_out_dir);
+calculate_charges(struct Molecules &molecules, const std::string &method_name, std::optional<const std::string> &parameters_name, std::optional<const std::string> &chg_out_dir, std::optional<std::vector<std::string>> &output_formats, std::optional<int> threads);
 
-void save_charges_python(std::map<std::string, std::vector<double>> charges, const Molecules &molecules, const std::string &method_name, std::optional<const std::string> parameters_name, std::optional<const std::string> chg_out_dir);
+void save_charges_python(std::map<std::string, std::vector<double>> charges, const Molecules &molecules, const std::string &method_name, std::optional<const std::string> parameters_name, std::optional<const std::string> chg_out_dir, std::optional<std::vector<std::string>> output_formats);
 
 std::vector<PythonMethodMetadata> get_available_methods_python();
 
@@ -175,9 +176,18 @@ std::optional<ParametersMetadata> get_best_parameters(struct Molecules &molecule
 }
 
 std::map<std::string, std::vector<double>>
-calculate_charges(struct Molecules &molecules, const std::string &method_name, std::optional<const std::string> &parameters_name, std::optional<const std::string> &chg_out_dir) {
+calculate_charges(struct Molecules &molecules, const std::string &method_name, std::optional<const std::string> &parameters_name, std::optional<const std::string> &chg_out_dir, std::optional<std::vector<std::string>> &output_formats, std::optional<int> threads) {
     config::chg_out_dir = chg_out_dir.value_or(".");
 
+    /* Applies to the calling thread only, concurrent calls from other Python threads keep their own setting */
+    if (threads.has_value()) {
+        if (threads.value() < 0) {
+            throw std::runtime_error("Number of threads must not be negative");
+        }
+        set_thread_count(threads.value());
+    }
+    config::output_formats = unique(output_formats.value_or(std::vector<std::string>{}));
+
     std::unique_ptr<Method> method;
     try {
         method = load_method(method_name);
@@ -212,13 +222,20 @@ calculate_charges(struct Molecules &molecules, const std::string &method_name, s
 
     auto charges = Charges(method->metadata().internal_name, parameters_name.value_or("None"));
     std::map<std::string, std::vector<double>> result;
-    for (auto &mol: molecules.ms.molecules()) {
-        auto results = method->calculate_charges(mol);
+
+    std::vector<std::vector<double>> computed(molecules.ms.molecules().size());
+    calculate_all_charges(*method, molecules.ms, [&computed](size_t i, std::vector<double> results) {
+        computed[i] = std::move(results);
+    });
+
+    for (size_t i = 0; i < computed.size(); i++) {
+        const auto &mol = molecules.ms.molecules()[i];
+        auto &results = computed[i];
         if (std::ranges::any_of(results, [](double chg) noexcept { return not isfinite(chg); })) {
             std::println("Incorrect values encountered for: {}. Skipping molecule.", mol.name());
         } else {
             charges.insert(mol.name(), results);
-            result[mol.name()] = results;
+            result[mol.name()] = std::move(results);
         }
     }
 
@@ -232,8 +249,9 @@ calculate_charges(struct Molecules &molecules, const std::string &method_name, s
 
 void save_charges_python(std::map<std::string, std::vector<double>> charges, const Molecules &molecules,
     const std::string &method_name, std::optional<const std::string> parameters_name,
-    std::optional<const std::string> chg_out_dir = ".") {
+    std::optional<const std::string> chg_out_dir = ".", std::optional<std::vector<std::string>> output_formats = std::nullopt) {
     config::chg_out_dir = chg_out_dir.value_or(".");
+    config::output_formats = unique(output_formats.value_or(std::vector<std::string>{}));
     config::input_file = molecules.input_file;
 
     Charges charges_to_save(method_name, parameters_name.value_or("None"));
@@ -305,6 +323,7 @@ PYBIND11_MODULE(chargefw2, m) {
           "Return the best parameters for a given set of molecules and method name");
     m.def("get_suitable_methods", &get_suitable_methods_python, "molecules"_a, "Get methods and parameters that are suitable for a given set of molecules");
     m.def("calculate_charges", &calculate_charges, "molecules"_a, "method_name"_a, py::arg("parameters_name") = py::none(), py::arg("chg_out_dir") = py::none(),
-          "Calculate partial atomic charges for a given molecules and method", py::call_guard<py::gil_scoped_release>());
-    m.def("save_charges", &save_charges_python, "molecules"_a, "charges"_a, "method_name"_a, py::arg("parameters_name") = py::none(), py::arg("chg_out_dir") = py::none());
+          py::arg("output_formats") = py::none(), py::arg("threads") = py::none(), "Calculate partial atomic charges for a given molecules and method", py::call_guard<py::gil_scoped_release>());
+    m.def("save_charges", &save_charges_python, "molecules"_a, "charges"_a, "method_name"_a, py::arg("parameters_name") = py::none(), py::arg("chg_out_dir") = py::none(),
+          py::arg("output_formats") = py::none());
 }
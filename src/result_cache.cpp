@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <print>
+#include <tuple>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include "chargefw2.h"
+#include "config.h"
+#include "ee_method.h"
+#include "result_cache.h"
+#include "utility/exceptions.h"
+#include "utility/hasher.h"
+
+
+/*
+ * File layout (native endianness, append-only):
+ *   Header
+ *   Record[]: uint64_t key[2], uint64_t n_charges, uint64_t checksum, double charges[n_charges]
+ * A record cut short by an interrupted run (or not matching its checksum) is discarded together with everything after
+ * it when the cache is opened. The file is locked for the whole run, so it is never appended to by two runs at once.
+ */
+
+namespace {
+    constexpr char MAGIC[8] = {'F', 'W', '2', 'R', 'E', 'S', '\0', '\0'};
+    constexpr uint32_t FORMAT_VERSION = 2;
+    constexpr uint32_t ENDIANNESS_CHECK = 0x01020304;
+
+    /* Pending records are written once they exceed this size */
+    constexpr size_t WRITE_THRESHOLD = 1 << 20;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t endianness;
+    };
+
+    struct RecordHeader {
+        uint64_t key[2];
+        uint64_t n_charges;
+        uint64_t checksum;
+    };
+
+    uint64_t checksum(const RecordHeader &record, const char *charges) {
+        Hasher hasher;
+        hasher.add(record.key[0]);
+        hasher.add(record.key[1]);
+        hasher.add(record.n_charges);
+        hasher.add_raw(charges, record.n_charges);
+        return hasher.digest()[0];
+    }
+
+    void write_all(int fd, const char *data, size_t size, const std::string &filename) {
+        while (size != 0) {
+            auto n = write(fd, data, size);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw FileException(std::format("Cannot write result cache {}: {}", filename, std::strerror(errno)));
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+}
+
+
+ResultCache::ResultCache(std::string filename, const Method &method, const Parameters *parameters)
+    : filename_{std::move(filename)} {
+    /* Everything except the molecule itself that determines the charges */
+    Hasher context;
+    context.add(std::string(VERSION));
+    context.add(method.metadata().internal_name);
+    context.add(parameters != nullptr ? parameters->metadata().internal_name : std::string("None"));
+    /* Parameter files may be edited or share a name, so their values are part of the key */
+    if (parameters != nullptr) {
+        for (const auto part: parameters->digest()) {
+            context.add(part);
+        }
+    }
+    for (const auto &[name, option]: method.get_options()) {
+        context.add(name);
+        context.add(method.get_option_value<std::string>(name));
+    }
+    context.add(static_cast<uint64_t>(config::permissive_types));
+    /* Methods solving the equalization in fragments may select a different mode in other settings */
+    if (const auto *ee_method = dynamic_cast<const EEMethod *>(&method); ee_method != nullptr) {
+        context.add(solver_settings(*ee_method));
+    }
+    context_ = context.digest();
+
+    fd_ = open(filename_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ == -1) {
+        throw FileException(std::format("Cannot open result cache: {}", filename_));
+    }
+    if (flock(fd_, LOCK_EX | LOCK_NB) == -1) {
+        close(fd_);
+        throw FileException(std::format("Result cache {} is used by another run", filename_));
+    }
+
+    std::error_code ec;
+    if (std::filesystem::file_size(filename_, ec) == 0) {
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FORMAT_VERSION;
+        header.endianness = ENDIANNESS_CHECK;
+        try {
+            write_all(fd_, reinterpret_cast<const char *>(&header), sizeof(header), filename_);
+        } catch (FileException &) {
+            close(fd_);
+            throw;
+        }
+        return;
+    }
+
+    try {
+        mapped_ = std::make_unique<MappedFile>(filename_);
+    } catch (FileException &) {
+        close(fd_);
+        throw;
+    }
+    const auto data = mapped_->view();
+
+    Header header{};
+    if (data.size() >= sizeof(header)) {
+        std::memcpy(&header, data.data(), sizeof(header));
+    }
+    if (data.size() < sizeof(header) or std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 or
+        header.version != FORMAT_VERSION or header.endianness != ENDIANNESS_CHECK) {
+        close(fd_);
+        throw FileException(std::format("File {} is not a result cache of this version", filename_));
+    }
+
+    size_t offset = sizeof(header);
+    while (offset + sizeof(RecordHeader) <= data.size()) {
+        RecordHeader record{};
+        std::memcpy(&record, data.data() + offset, sizeof(record));
+        const size_t begin = offset + sizeof(record);
+        if (record.n_charges > (data.size() - begin) / sizeof(double) or
+            record.checksum != checksum(record, data.data() + begin)) {
+            break;
+        }
+        entries_.insert_or_assign(Key{record.key[0], record.key[1]}, std::pair{begin, record.n_charges});
+        offset = begin + record.n_charges * sizeof(double);
+    }
+
+    /* New records must follow the last complete one */
+    if (offset != data.size() and ftruncate(fd_, static_cast<off_t>(offset)) == -1) {
+        close(fd_);
+        throw FileException(std::format("Cannot repair result cache: {}", filename_));
+    }
+}
+
+
+ResultCache::~ResultCache() {
+    try {
+        write_pending();
+    } catch (FileException &e) {
+        std::println(stderr, "{}", e.what());
+    }
+    fdatasync(fd_);
+    close(fd_);
+}
+
+
+ResultCache::Key ResultCache::key(const Molecule &molecule) const {
+    Hasher hasher(context_);
+
+    const auto &atoms = molecule.atoms();
+    hasher.add(static_cast<uint64_t>(atoms.size()));
+    for (const auto &atom: atoms) {
+        hasher.add(static_cast<uint64_t>(atom.element().Z()));
+        for (double coordinate: atom.pos()) {
+            hasher.add(coordinate);
+        }
+        hasher.add(static_cast<uint64_t>(atom.formal_charge()));
+    }
+
+    /* The order of bonds depends on the reader, only the set of them matters */
+    std::vector<std::tuple<size_t, size_t, int>> bonds;
+    bonds.reserve(molecule.bonds().size());
+    for (const auto &bond: molecule.bonds()) {
+        const size_t i = bond.first().index();
+        const size_t j = bond.second().index();
+        bonds.emplace_back(std::min(i, j), std::max(i, j), bond.order());
+    }
+    std::ranges::sort(bonds);
+
+    hasher.add(static_cast<uint64_t>(bonds.size()));
+    for (const auto &[i, j, order]: bonds) {
+        hasher.add(static_cast<uint64_t>(i));
+        hasher.add(static_cast<uint64_t>(j));
+        hasher.add(static_cast<uint64_t>(order));
+    }
+
+    return hasher.digest();
+}
+
+
+std::optional<std::vector<double>> ResultCache::find(const Key &key) const {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+
+    const auto [offset, count] = it->second;
+    std::vector<double> charges(count);
+    std::memcpy(charges.data(), mapped_->view().data() + offset, count * sizeof(double));
+    return charges;
+}
+
+
+void ResultCache::store(const Key &key, const std::vector<double> &charges) {
+    RecordHeader record{{key[0], key[1]}, charges.size(), 0};
+    record.checksum = checksum(record, reinterpret_cast<const char *>(charges.data()));
+
+    std::lock_guard lock(mutex_);
+    const auto *begin = reinterpret_cast<const char *>(&record);
+    pending_.insert(pending_.end(), begin, begin + sizeof(record));
+    const auto *values = reinterpret_cast<const char *>(charges.data());
+    pending_.insert(pending_.end(), values, values + charges.size() * sizeof(double));
+
+    if (pending_.size() >= WRITE_THRESHOLD) {
+        write_pending();
+    }
+}
+
+
+void ResultCache::write_pending() {
+    write_all(fd_, pending_.data(), pending_.size(), filename_);
+    pending_.clear();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "method.h"
+#include "parameters.h"
+#include "structures/molecule.h"
+#include "utility/hasher.h"
+#include "utility/mapped_file.h"
+
+
+/* Persistent cache of computed charges, see result_cache.cpp for the layout. Molecules are identified by a hash of
+ * everything the charges depend on: elements, coordinates, formal charges and bonds of the molecule together with
+ * the method, its parameters and options. Names are not part of the key, so repeated structures are found as well */
+class ResultCache {
+public:
+    using Key = Hasher::Digest;
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key &key) const noexcept { return key[0]; }
+    };
+
+    std::string filename_;
+    std::unique_ptr<MappedFile> mapped_{nullptr};
+    /* Offset and count of the charges of each record in the mapped file */
+    std::unordered_map<Key, std::pair<size_t, size_t>, KeyHash> entries_{};
+    Key context_{};
+
+    int fd_{-1};
+    std::mutex mutex_{};
+    std::vector<char> pending_{};
+
+    void write_pending();
+
+public:
+    ResultCache(std::string filename, const Method &method, const Parameters *parameters);
+
+    ResultCache(const ResultCache &) = delete;
+
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    /* New results are written and synced to the disk */
+    ~ResultCache();
+
+    [[nodiscard]] Key key(const Molecule &molecule) const;
+
+    [[nodiscard]] std::optional<std::vector<double>> find(const Key &key) const;
+
+    /* May be called concurrently; the results become visible to lookups of the next run */
+    void store(const Key &key, const std::vector<double> &charges);
+
+    [[nodiscard]] size_t size() const { return entries_.size(); }
+};
@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <print>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <omp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "candidates.h"
+#include "charges.h"
+#include "config.h"
+#include "executor.h"
+#include "method.h"
+#include "parameters.h"
+#include "formats/reader.h"
+#include "formats/save_charges.h"
+#include "utility/compression.h"
+#include "utility/exceptions.h"
+#include "utility/strings.h"
+
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+
+/* Charges of each molecule; nothing if the method returned numerically incorrect values */
+using JobResult = std::vector<std::optional<std::vector<double>>>;
+
+struct Job {
+    const MoleculeSet &ms;
+    const Method &method;
+    std::promise<JobResult> result{};
+};
+
+
+/* Inline structures are stored in a temporary file, since the readers (and the mmCIF writer) work with files */
+class TemporaryFile {
+    std::string path_;
+public:
+    TemporaryFile(const std::string &content, const std::string &extension) {
+        path_ = (fs::temp_directory_path() / ("chargefw2-XXXXXX" + extension)).string();
+        int fd = mkstemps(path_.data(), static_cast<int>(extension.size()));
+        if (fd == -1) {
+            throw FileException(std::format("Cannot create temporary file: {}", std::strerror(errno)));
+        }
+
+        size_t written = 0;
+        while (written < content.size()) {
+            auto n = write(fd, content.data() + written, content.size() - written);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                close(fd);
+                unlink(path_.c_str());
+                throw FileException(std::format("Cannot write temporary file: {}", std::strerror(errno)));
+            }
+            written += static_cast<size_t>(n);
+        }
+        close(fd);
+    }
+
+    TemporaryFile(const TemporaryFile &) = delete;
+
+    TemporaryFile &operator=(const TemporaryFile &) = delete;
+
+    ~TemporaryFile() { unlink(path_.c_str()); }
+
+    [[nodiscard]] const std::string &path() const { return path_; }
+};
+
+
+static JobResult compute_job(const Job &job) {
+    JobResult results(job.ms.molecules().size());
+    calculate_all_charges(job.method, job.ms, [&results](size_t i, std::vector<double> charges) {
+        if (std::ranges::all_of(charges, [](double chg) noexcept { return std::isfinite(chg); })) {
+            results[i] = std::move(charges);
+        }
+    });
+    return results;
+}
+
+
+static void run_job(Job &job) {
+    try {
+        job.result.set_value(compute_job(job));
+    } catch (...) {
+        job.result.set_exception(std::current_exception());
+    }
+}
+
+
+/* Jobs are scheduled like files in batch mode, with the number of atoms as the estimate of work */
+static void run_jobs(const std::vector<Job *> &jobs) {
+    const size_t n = jobs.size();
+    std::vector<size_t> sizes(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        for (const auto &molecule: jobs[i]->ms.molecules()) {
+            sizes[i] += molecule.atoms().size();
+        }
+    }
+
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    const size_t total_size = std::accumulate(sizes.begin(), sizes.end(), size_t{0});
+    const auto threads = static_cast<size_t>(omp_get_max_threads());
+
+    size_t first_small = 0;
+    while (first_small < n and sizes[order[first_small]] * threads >= total_size) {
+        run_job(*jobs[order[first_small]]);
+        first_small++;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) default(none) shared(jobs, order) firstprivate(n, first_small)
+    for (size_t i = first_small; i < n; i++) {
+        run_job(*jobs[order[i]]);
+    }
+}
+
+
+static void set_method_options(Method &method, const json &options) {
+    for (const auto &[opt, info]: method.get_options()) {
+        method.set_option_value(opt, info.default_value);
+    }
+
+    const auto available = method.get_options();
+    for (const auto &[opt, value]: options.items()) {
+        auto it = available.find(opt);
+        if (it == available.end()) {
+            throw ParameterException(
+                    std::format("Unknown option of method {}: {}", method.metadata().internal_name, opt));
+        }
+
+        auto val = value.is_string() ? value.get<std::string>() : value.dump();
+        const auto &choices = it->second.choices;
+        if (not choices.empty() and std::ranges::find(choices, val) == choices.end()) {
+            throw ParameterException(std::format("Provided value: {} not in possible choices", val));
+        }
+        method.set_option_value(opt, val);
+    }
+}
+
+
+static bool send_all(int fd, const std::string &text) {
+    size_t sent = 0;
+    while (sent < text.size()) {
+        auto n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+
+class Server {
+    /* Connections beyond this wait in the backlog of the socket until one of the served ones is closed */
+    static constexpr std::ptrdiff_t MAX_CONNECTIONS = 64;
+
+    std::counting_semaphore<MAX_CONNECTIONS> connections_{MAX_CONNECTIONS};
+    std::atomic<size_t> next_job_{1};
+
+    std::mutex parameters_mutex_{};
+    std::map<std::string, std::vector<std::unique_ptr<Parameters>>> parameters_{};
+
+    std::mutex queue_mutex_{};
+    std::condition_variable queue_cv_{};
+    std::vector<Job *> queue_{};
+
+    const std::vector<std::unique_ptr<Parameters>> &method_parameters(const std::string &method_name);
+
+    JobResult compute(const MoleculeSet &ms, const Method &method);
+
+    void compute_queued();
+
+    json handle(const json &request);
+
+    void serve_connection(int fd);
+
+public:
+    void run(const std::string &socket_path);
+};
+
+
+const std::vector<std::unique_ptr<Parameters>> &Server::method_parameters(const std::string &method_name) {
+    /* Parameter sets are loaded on the first job of the method and never modified afterwards */
+    std::lock_guard lock(parameters_mutex_);
+    auto it = parameters_.find(method_name);
+    if (it == parameters_.end()) {
+        it = parameters_.emplace(method_name, load_method_parameters(method_name)).first;
+    }
+    return it->second;
+}
+
+
+JobResult Server::compute(const MoleculeSet &ms, const Method &method) {
+    Job job{ms, method};
+    auto result = job.result.get_future();
+    {
+        std::lock_guard lock(queue_mutex_);
+        queue_.push_back(&job);
+    }
+    queue_cv_.notify_one();
+    return result.get();
+}
+
+
+void Server::compute_queued() {
+    /* Thread settings of OpenMP are per thread, the computing thread has to set them on its own */
+    set_thread_count(config::threads);
+
+    while (true) {
+        std::vector<Job *> jobs;
+        {
+            std::unique_lock lock(queue_mutex_);
+            queue_cv_.wait(lock, [this] { return not queue_.empty(); });
+            jobs.swap(queue_);
+        }
+        run_jobs(jobs);
+    }
+}
+
+
+json Server::handle(const json &request) {
+    const auto method_name = request.at("method").get<std::string>();
+    const auto job_id = next_job_++;
+
+    std::optional<TemporaryFile> structure;
+    std::string input_file;
+    std::string output_name;
+    if (request.contains("input")) {
+        input_file = request["input"].get<std::string>();
+        output_name = input_file;
+    } else if (request.contains("structure")) {
+        const auto format = request.value("format", std::string("sdf"));
+        output_name = request.value("name", "structure." + format);
+        if (not is_supported_input_file(output_name)) {
+            throw FileException(std::format("Filetype of {} not supported", output_name));
+        }
+        structure.emplace(request["structure"].get<std::string>(),
+                          fs::path(strip_compression_extension(output_name)).extension().string());
+        input_file = structure->path();
+    } else {
+        throw ParameterException("Job has to contain either an input file or a structure");
+    }
+
+    auto ms = load_molecule_set(input_file);
+    if (ms.molecules().empty()) {
+        throw FileException("No molecules were loaded from the input");
+    }
+
+    auto method = load_method(method_name);
+    set_method_options(*method, request.value("options", json::object()));
+
+    Parameters *parameters = nullptr;
+    if (method->has_parameters()) {
+        const auto &candidates = method_parameters(method_name);
+        if (request.contains("parameters")) {
+            const auto name = request["parameters"].get<std::string>();
+            auto it = std::ranges::find_if(candidates, [&name](const auto &p) {
+                return p->metadata().internal_name == name;
+            });
+            if (it == candidates.end()) {
+                throw ParameterException(std::format("Unknown parameters: {}", name));
+            }
+            parameters = it->get();
+        } else {
+            parameters = best_parameters(ms, candidates, ms.has_proteins(), config::permissive_types);
+            if (parameters == nullptr) {
+                throw ParameterException("No parameters found");
+            }
+        }
+        ms.classify_set_from_parameters(*parameters, true, config::permissive_types);
+        method->set_parameters(parameters);
+    } else {
+        ms.classify_atoms(AtomClassifier::PLAIN);
+    }
+
+    ms.fulfill_requirements(method->get_requirements());
+
+    auto results = compute(ms, *method);
+
+    const std::string parameters_name = parameters != nullptr ? parameters->name() : "None";
+    Charges charges(method->metadata().name, parameters_name);
+    json molecules = json::array();
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &name = ms.molecules()[i].name();
+        if (results[i].has_value()) {
+            molecules.push_back({{"name", name}, {"charges", *results[i]}});
+            charges.insert(name, std::move(*results[i]));
+        } else {
+            molecules.push_back({{"name", name}, {"charges", nullptr}});
+        }
+    }
+
+    json response = {
+        {"status", "ok"},
+        {"job", job_id},
+        {"method", method->metadata().name},
+        {"parameters", parameters_name},
+        {"molecules", std::move(molecules)},
+    };
+
+    if (request.value("write", false)) {
+        if (config::chg_out_dir.empty()) {
+            throw ParameterException("Directory where to store charges was not provided");
+        }
+        /* Jobs of the same input or structure name must not overwrite each other's files */
+        const auto unique_name = std::format("{}-{}", job_id, fs::path(output_name).filename().string());
+        save_charges(ms, charges, unique_name, input_file);
+        response["output_dir"] = config::chg_out_dir;
+        response["output_name"] = unique_name;
+    }
+
+    return response;
+}
+
+
+void Server::serve_connection(int fd) {
+    std::string pending;
+    std::vector<char> buffer(1 << 16);
+
+    while (true) {
+        auto n = recv(fd, buffer.data(), buffer.size(), 0);
+        if (n == -1 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        pending.append(buffer.data(), static_cast<size_t>(n));
+
+        /* Requests of a single connection are answered in order, concurrent jobs come from separate connections */
+        size_t end;
+        while ((end = pending.find('\n')) != std::string::npos) {
+            auto line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            if (trim(line).empty()) {
+                continue;
+            }
+
+            json response;
+            try {
+                response = handle(json::parse(line));
+            } catch (std::exception &e) {
+                response = {{"status", "error"}, {"message", e.what()}};
+            }
+
+            if (not send_all(fd, response.dump(-1, ' ', false, json::error_handler_t::replace) + "\n")) {
+                close(fd);
+                connections_.release();
+                return;
+            }
+        }
+    }
+
+    close(fd);
+    connections_.release();
+}
+
+
+void Server::run(const std::string &socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw ParameterException(std::format("Socket path is too long: {}", socket_path));
+    }
+    std::ranges::copy(socket_path, address.sun_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == -1) {
+        throw InternalException(std::format("Cannot create socket: {}", std::strerror(errno)));
+    }
+
+    /* A socket left behind by a previous run would prevent binding */
+    if (fs::is_socket(socket_path)) {
+        fs::remove(socket_path);
+    }
+
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 or
+        listen(listener, SOMAXCONN) == -1) {
+        throw FileException(std::format("Cannot listen on {}: {}", socket_path, std::strerror(errno)));
+    }
+
+    std::thread(&Server::compute_queued, this).detach();
+
+    std::println("Listening on {}", socket_path);
+    std::fflush(stdout);
+
+    while (true) {
+        connections_.acquire();
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EINTR) {
+                std::println(stderr, "Cannot accept connection: {}", std::strerror(errno));
+            }
+            connections_.release();
+            continue;
+        }
+        std::thread(&Server::serve_connection, this, fd).detach();
+    }
+}
+
+
+void serve(const std::string &socket_path) {
+    /* Connection threads are detached, so the server must outlive them */
+    static Server server;
+    server.run(socket_path);
+}
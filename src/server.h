@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+
+/* Accept jobs on a Unix domain socket until the process is terminated. Each request and response is a single line of
+ * JSON; parameter sets stay loaded between jobs and jobs submitted at the same time are computed together */
+void serve(const std::string &socket_path);
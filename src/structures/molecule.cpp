@@ -174,6 +174,21 @@ std::vector<const Atom *> Molecule::get_close_atoms(const Atom &atom, double cut
 }
 
 
+std::vector<const Atom *> Molecule::get_close_atoms(const std::array<double, 3> &point, double cutoff) const {
+    std::vector<const Atom *> close_atoms;
+
+    std::vector<nanoflann::ResultItem<uint32_t , double>> results;
+    nanoflann::SearchParameters params;
+
+    auto matches_count = index_->radiusSearch(point.data(), cutoff * cutoff, results, params);
+    close_atoms.reserve(matches_count);
+    for (size_t i = 0; i < matches_count; i++) {
+        close_atoms.push_back(&atoms()[results[i].first]);
+    }
+    return close_atoms;
+}
+
+
 const Bond *Molecule::get_bond(const Atom &atom1, const Atom &atom2) const {
     for (const auto &bond: *bonds_) {
         if ((atom1 == bond.first() and atom2 == bond.second()) or (atom1 == bond.second() and atom2 == bond.first()))
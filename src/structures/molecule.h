@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 #include <map>
@@ -57,6 +58,8 @@ public:
 
     [[nodiscard]] std::vector<const Atom *> get_close_atoms(const Atom &atom, double cutoff) const;
 
+    [[nodiscard]] std::vector<const Atom *> get_close_atoms(const std::array<double, 3> &point, double cutoff) const;
+
     Molecule() = default;
 
     Molecule(std::string name, std::unique_ptr<std::vector<Atom> > atoms, std::unique_ptr<std::vector<Bond> > bonds);
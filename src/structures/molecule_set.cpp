@@ -223,7 +223,7 @@ void MoleculeSet::set_type(AB &object, const AB_t &type) {
 
 
 template<typename AB, typename AB_t>
-size_t MoleculeSet::classify_objects_from_parameters(const Parameters &parameters,
+std::vector<int> MoleculeSet::classify_objects_from_parameters(const Parameters &parameters,
                                                      bool remove_unclassified,
                                                      bool permissive_types) {
 
@@ -308,7 +308,7 @@ size_t MoleculeSet::classify_objects_from_parameters(const Parameters &parameter
             molecules_->erase(molecules_->begin() + unclassified[unclassified.size() - i - 1]);
         }
     }
-    return unclassified.size();
+    return unclassified;
 }
 
 
@@ -316,17 +316,36 @@ size_t MoleculeSet::classify_set_from_parameters(const Parameters &parameters, b
                                                  bool permissive_types) {
     size_t unclassified = 0;
     if (parameters.atom() != nullptr) {
-        unclassified += classify_objects_from_parameters<Atom>(parameters, remove_unclassified, permissive_types);
+        unclassified += classify_objects_from_parameters<Atom>(parameters, remove_unclassified, permissive_types).size();
     }
 
     if (parameters.bond() != nullptr) {
-        unclassified += classify_objects_from_parameters<Bond>(parameters, remove_unclassified, permissive_types);
+        unclassified += classify_objects_from_parameters<Bond>(parameters, remove_unclassified, permissive_types).size();
     }
 
     return unclassified;
 }
 
 
+std::vector<bool> MoleculeSet::classify_set_from_parameters_masked(const Parameters &parameters,
+                                                                   bool permissive_types) {
+    std::vector<bool> covered(molecules_->size(), true);
+    if (parameters.atom() != nullptr) {
+        for (auto idx: classify_objects_from_parameters<Atom>(parameters, false, permissive_types)) {
+            covered[idx] = false;
+        }
+    }
+
+    if (parameters.bond() != nullptr) {
+        for (auto idx: classify_objects_from_parameters<Bond>(parameters, false, permissive_types)) {
+            covered[idx] = false;
+        }
+    }
+
+    return covered;
+}
+
+
 void MoleculeSet::fulfill_requirements(const std::vector<RequiredFeatures> &features) {
     for (const auto req: features) {
         switch (req) {
@@ -61,10 +61,11 @@ class MoleculeSet {
     template<typename AB, typename AB_t = typename deduce_from<AB>::AB_t>
     void set_type(AB &object, const AB_t &type);
 
+    /* Returns indices of the molecules with unclassified objects (before their removal) */
     template<typename AB, typename AB_t = typename deduce_from<AB>::AB_t>
-    size_t classify_objects_from_parameters(const Parameters &parameters,
-                                            bool remove_unclassified,
-                                            bool permissive_types);
+    std::vector<int> classify_objects_from_parameters(const Parameters &parameters,
+                                                      bool remove_unclassified,
+                                                      bool permissive_types);
 
 public:
     explicit MoleculeSet() = default;
@@ -84,6 +85,9 @@ public:
     size_t classify_set_from_parameters(const Parameters &parameters, bool remove_unclassified = true,
                                         bool permissive_types = false);
 
+    /* Classify the whole set but keep the molecules not covered by the parameters; true marks the covered ones */
+    std::vector<bool> classify_set_from_parameters_masked(const Parameters &parameters, bool permissive_types = false);
+
     [[nodiscard]] std::vector<atom_t> atom_types() const { return atom_types_; }
 
     [[nodiscard]] std::vector<bond_t> bond_types() const { return bond_types_; }
@@ -0,0 +1,527 @@
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef CHARGEFW2_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compression.h"
+#include "exceptions.h"
+#include "strings.h"
+
+
+namespace {
+    constexpr size_t CHUNK_SIZE = 1 << 20;
+    constexpr size_t MAX_QUEUED_CHUNKS = 8;
+    constexpr int ZSTD_LEVEL = 3;
+
+
+    [[noreturn]] void zstd_not_available() {
+        throw FileException("ChargeFW2 was built without zstd support");
+    }
+
+
+    /* Reads compressed file on a background thread and hands out decompressed chunks */
+    class DecompressingStreamBuf final : public std::streambuf {
+        std::string filename_;
+        Compression compression_;
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<std::string> chunks_;
+        bool finished_{false};
+        bool stop_{false};
+        std::exception_ptr error_{nullptr};
+
+        std::string current_;
+        std::thread worker_;
+
+        /* Return false if the consumer is gone */
+        bool push(std::string chunk) {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ or chunks_.size() < MAX_QUEUED_CHUNKS; });
+            if (stop_) {
+                return false;
+            }
+            chunks_.push_back(std::move(chunk));
+            cv_.notify_all();
+            return true;
+        }
+
+        void inflate_gzip() {
+            gzFile file = gzopen(filename_.c_str(), "rb");
+            if (file == nullptr) {
+                throw FileException(std::format("Cannot open file: {}", filename_));
+            }
+            gzbuffer(file, CHUNK_SIZE);
+
+            while (true) {
+                std::string chunk(CHUNK_SIZE, '\0');
+                int read = gzread(file, chunk.data(), static_cast<unsigned>(chunk.size()));
+
+                /* Truncated input is reported through gzerror only */
+                int err = Z_OK;
+                const char *msg = gzerror(file, &err);
+                if (read < 0 or (err != Z_OK and err != Z_STREAM_END)) {
+                    std::string reason = msg;
+                    gzclose(file);
+                    throw FileException(std::format("Cannot decompress file {}: {}", filename_, reason));
+                }
+                if (read == 0) {
+                    break;
+                }
+                chunk.resize(static_cast<size_t>(read));
+                if (not push(std::move(chunk))) {
+                    break;
+                }
+            }
+            gzclose(file);
+        }
+
+        void inflate_zstd() {
+#ifdef CHARGEFW2_HAVE_ZSTD
+            auto file = std::fopen(filename_.c_str(), "rb");
+            if (file == nullptr) {
+                throw FileException(std::format("Cannot open file: {}", filename_));
+            }
+
+            auto dctx = ZSTD_createDCtx();
+            std::vector<char> input(ZSTD_DStreamInSize());
+            bool consumer_gone = false;
+            /* Non-zero while a frame is not complete */
+            size_t last = 0;
+            size_t read;
+            while (not consumer_gone and (read = std::fread(input.data(), 1, input.size(), file)) > 0) {
+                ZSTD_inBuffer in = {input.data(), read, 0};
+                /* A full output buffer may leave data in the decoder even if the input is consumed */
+                bool full;
+                do {
+                    std::string chunk(ZSTD_DStreamOutSize(), '\0');
+                    ZSTD_outBuffer out = {chunk.data(), chunk.size(), 0};
+                    last = ZSTD_decompressStream(dctx, &out, &in);
+                    if (ZSTD_isError(last)) {
+                        ZSTD_freeDCtx(dctx);
+                        std::fclose(file);
+                        throw FileException(std::format("Cannot decompress file {}: {}", filename_,
+                                                        ZSTD_getErrorName(last)));
+                    }
+                    full = out.pos == out.size;
+                    chunk.resize(out.pos);
+                    if (not chunk.empty() and not push(std::move(chunk))) {
+                        consumer_gone = true;
+                        break;
+                    }
+                } while (in.pos < in.size or full);
+            }
+            ZSTD_freeDCtx(dctx);
+            const bool failed = std::ferror(file) != 0;
+            std::fclose(file);
+
+            /* A file cut off in the middle of a frame ends without an error from the decoder */
+            if (not consumer_gone and (failed or last != 0)) {
+                throw FileException(std::format("Cannot decompress file {}: {}", filename_,
+                                                failed ? "read error" : "truncated"));
+            }
+#else
+            zstd_not_available();
+#endif
+        }
+
+        void produce() {
+            try {
+                if (compression_ == Compression::GZIP) {
+                    inflate_gzip();
+                } else {
+                    inflate_zstd();
+                }
+            } catch (...) {
+                std::lock_guard lock(mutex_);
+                error_ = std::current_exception();
+            }
+
+            std::lock_guard lock(mutex_);
+            finished_ = true;
+            cv_.notify_all();
+        }
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return not chunks_.empty() or finished_; });
+
+            if (chunks_.empty()) {
+                if (error_) {
+                    /* std::istream sets badbit and rethrows since InputStream enables badbit exceptions */
+                    std::rethrow_exception(error_);
+                }
+                return traits_type::eof();
+            }
+
+            current_ = std::move(chunks_.front());
+            chunks_.pop_front();
+            cv_.notify_all();
+
+            setg(current_.data(), current_.data(), current_.data() + current_.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+    public:
+        DecompressingStreamBuf(std::string filename, Compression compression) :
+                filename_{std::move(filename)}, compression_{compression} {
+            worker_ = std::thread(&DecompressingStreamBuf::produce, this);
+        }
+
+        ~DecompressingStreamBuf() override {
+            {
+                std::lock_guard lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            worker_.join();
+        }
+    };
+
+
+    class InputStream final : public std::istream {
+        DecompressingStreamBuf buf_;
+
+    public:
+        InputStream(const std::string &filename, Compression compression) :
+                std::istream(nullptr), buf_(filename, compression) {
+            rdbuf(&buf_);
+            exceptions(std::ios::badbit);
+        }
+    };
+
+
+    /* Compresses everything written to it and stores it into a file */
+    class CompressingStreamBuf final : public std::streambuf {
+        std::string filename_;
+        Compression compression_;
+        std::vector<char> buffer_;
+
+        gzFile gz_{nullptr};
+        std::FILE *file_{nullptr};
+#ifdef CHARGEFW2_HAVE_ZSTD
+        ZSTD_CCtx *cctx_{nullptr};
+        std::vector<char> zstd_out_;
+#endif
+
+        bool write_zstd(const char *data, size_t size, [[maybe_unused]] bool end) {
+#ifdef CHARGEFW2_HAVE_ZSTD
+            ZSTD_inBuffer in = {data, size, 0};
+            const auto mode = end ? ZSTD_e_end : ZSTD_e_continue;
+            while (true) {
+                ZSTD_outBuffer out = {zstd_out_.data(), zstd_out_.size(), 0};
+                size_t remaining = ZSTD_compressStream2(cctx_, &out, &in, mode);
+                if (ZSTD_isError(remaining)) {
+                    return false;
+                }
+                if (std::fwrite(zstd_out_.data(), 1, out.pos, file_) != out.pos) {
+                    return false;
+                }
+                if (end ? remaining == 0 : in.pos == in.size) {
+                    return true;
+                }
+            }
+#else
+            return data == nullptr and size == 0;
+#endif
+        }
+
+        bool flush_buffer() {
+            auto size = static_cast<size_t>(pptr() - pbase());
+            bool ok = true;
+            if (size != 0) {
+                if (compression_ == Compression::GZIP) {
+                    ok = gzwrite(gz_, pbase(), static_cast<unsigned>(size)) == static_cast<int>(size);
+                } else {
+                    ok = write_zstd(pbase(), size, false);
+                }
+            }
+            setp(buffer_.data(), buffer_.data() + buffer_.size());
+            return ok;
+        }
+
+    protected:
+        int_type overflow(int_type ch) override {
+            if (not flush_buffer()) {
+                return traits_type::eof();
+            }
+            if (not traits_type::eq_int_type(ch, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(ch);
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+
+        int sync() override {
+            return flush_buffer() ? 0 : -1;
+        }
+
+    public:
+        CompressingStreamBuf(std::string filename, Compression compression) :
+                filename_{std::move(filename)}, compression_{compression}, buffer_(CHUNK_SIZE) {
+            if (compression_ == Compression::GZIP) {
+                gz_ = gzopen(filename_.c_str(), "wb");
+                if (gz_ == nullptr) {
+                    throw FileException(std::format("Cannot open file: {}", filename_));
+                }
+            } else {
+#ifdef CHARGEFW2_HAVE_ZSTD
+                file_ = std::fopen(filename_.c_str(), "wb");
+                if (file_ == nullptr) {
+                    throw FileException(std::format("Cannot open file: {}", filename_));
+                }
+                cctx_ = ZSTD_createCCtx();
+                ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, ZSTD_LEVEL);
+                zstd_out_.resize(ZSTD_CStreamOutSize());
+#else
+                zstd_not_available();
+#endif
+            }
+            setp(buffer_.data(), buffer_.data() + buffer_.size());
+        }
+
+        /* Write the rest of the data, finish the compressed stream and close the file; false if any of it failed */
+        bool close() {
+            bool ok = flush_buffer();
+            if (gz_ != nullptr) {
+                ok = gzclose(gz_) == Z_OK and ok;
+                gz_ = nullptr;
+            }
+#ifdef CHARGEFW2_HAVE_ZSTD
+            if (cctx_ != nullptr) {
+                ok = write_zstd(nullptr, 0, true) and ok;
+                ZSTD_freeCCtx(cctx_);
+                cctx_ = nullptr;
+            }
+#endif
+            if (file_ != nullptr) {
+                ok = std::fclose(file_) == 0 and ok;
+                file_ = nullptr;
+            }
+            return ok;
+        }
+
+        /* Errors can no longer be reported here, close_output_stream should be used instead */
+        ~CompressingStreamBuf() override {
+            close();
+        }
+    };
+
+
+    class OutputStream final : public std::ostream {
+        CompressingStreamBuf buf_;
+
+    public:
+        OutputStream(const std::string &filename, Compression compression) :
+                std::ostream(nullptr), buf_(filename, compression) {
+            rdbuf(&buf_);
+        }
+
+        bool close() {
+            return buf_.close();
+        }
+    };
+}
+
+
+Compression compression_from_filename(const std::string &filename) {
+    auto ext = to_lowercase(std::filesystem::path(filename).extension().string());
+    if (ext == ".gz") {
+        return Compression::GZIP;
+    }
+    if (ext == ".zst") {
+        return Compression::ZSTD;
+    }
+    return Compression::NONE;
+}
+
+
+Compression compression_from_name(const std::string &name) {
+    if (name == "none") {
+        return Compression::NONE;
+    }
+    if (name == "gzip") {
+        return Compression::GZIP;
+    }
+    if (name == "zstd") {
+        return Compression::ZSTD;
+    }
+    throw ParameterException(std::format("Unknown compression: {}", name));
+}
+
+
+bool compression_available(Compression compression) {
+#ifdef CHARGEFW2_HAVE_ZSTD
+    return true;
+#else
+    return compression != Compression::ZSTD;
+#endif
+}
+
+
+std::string compression_extension(Compression compression) {
+    switch (compression) {
+        case Compression::GZIP:
+            return ".gz";
+        case Compression::ZSTD:
+            return ".zst";
+        case Compression::NONE:
+            break;
+    }
+    return "";
+}
+
+
+std::string strip_compression_extension(const std::string &filename) {
+    if (compression_from_filename(filename) == Compression::NONE) {
+        return filename;
+    }
+    return std::filesystem::path(filename).replace_extension().string();
+}
+
+
+std::unique_ptr<std::istream> open_input_stream(const std::string &filename) {
+    auto compression = compression_from_filename(filename);
+    if (compression == Compression::NONE) {
+        auto file = std::make_unique<std::ifstream>(filename);
+        if (not *file) {
+            throw FileException(std::format("Cannot open file: {}", filename));
+        }
+        return file;
+    }
+
+    if (not std::filesystem::exists(filename)) {
+        throw FileException(std::format("Cannot open file: {}", filename));
+    }
+    return std::make_unique<InputStream>(filename, compression);
+}
+
+
+std::unique_ptr<std::ostream> open_output_stream(const std::string &filename) {
+    auto compression = compression_from_filename(filename);
+    if (compression == Compression::NONE) {
+        auto file = std::make_unique<std::ofstream>(filename);
+        if (not *file) {
+            throw FileException(std::format("Cannot open file: {}", filename));
+        }
+        return file;
+    }
+    return std::make_unique<OutputStream>(filename, compression);
+}
+
+
+void close_output_stream(std::ostream &stream, const std::string &filename) {
+    bool ok = static_cast<bool>(stream.flush());
+    if (auto *compressed = dynamic_cast<OutputStream *>(&stream)) {
+        ok = compressed->close() and ok;
+    } else if (auto *file = dynamic_cast<std::ofstream *>(&stream)) {
+        file->close();
+        ok = ok and not file->fail();
+    }
+
+    if (not ok) {
+        throw FileException(std::format("Cannot write file: {}", filename));
+    }
+}
+
+
+void write_chunks(const std::string &filename, const std::vector<std::string_view> &chunks) {
+    if (compression_from_filename(filename) != Compression::NONE) {
+        auto stream = open_output_stream(filename);
+        for (const auto &chunk: chunks) {
+            stream->write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        }
+        close_output_stream(*stream, filename);
+        return;
+    }
+
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw FileException(std::format("Cannot open file: {}", filename));
+    }
+
+    std::vector<iovec> iov;
+    for (const auto &chunk: chunks) {
+        if (not chunk.empty()) {
+            iov.push_back({const_cast<char *>(chunk.data()), chunk.size()});
+        }
+    }
+
+    size_t first = 0;
+    while (first < iov.size()) {
+        auto count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+        ssize_t written = ::writev(fd, iov.data() + first, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            auto reason = std::strerror(errno);
+            ::close(fd);
+            throw FileException(std::format("Cannot write file {}: {}", filename, reason));
+        }
+
+        /* Skip fully written chunks and continue with the remainder of a partially written one */
+        auto remaining = static_cast<size_t>(written);
+        while (first < iov.size() and remaining >= iov[first].iov_len) {
+            remaining -= iov[first].iov_len;
+            first++;
+        }
+        if (remaining > 0) {
+            iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + remaining;
+            iov[first].iov_len -= remaining;
+        }
+    }
+
+    if (::close(fd) != 0) {
+        throw FileException(std::format("Cannot write file: {}", filename));
+    }
+}
+
+
+void write_chunks(const std::string &filename, const std::vector<std::string> &chunks) {
+    write_chunks(filename, std::vector<std::string_view>(chunks.begin(), chunks.end()));
+}
+
+
+InputBuffer::InputBuffer(const std::string &filename) {
+    if (compression_from_filename(filename) == Compression::NONE) {
+        mapped_ = std::make_unique<MappedFile>(filename);
+        return;
+    }
+
+    auto stream = open_input_stream(filename);
+    data_.assign(std::istreambuf_iterator<char>(*stream), std::istreambuf_iterator<char>());
+}
+
+
+std::string_view InputBuffer::view() const {
+    if (mapped_) {
+        return mapped_->view();
+    }
+    return data_;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+
+
+enum class Compression {
+    NONE,
+    GZIP,
+    ZSTD
+};
+
+
+/* Detect compression from the last extension of the file (.gz or .zst) */
+Compression compression_from_filename(const std::string &filename);
+
+/* Convert the user-facing name (none, gzip, zstd) to the enum */
+Compression compression_from_name(const std::string &name);
+
+/* Whether ChargeFW2 was built with support of the compression (zstd is optional) */
+bool compression_available(Compression compression);
+
+std::string compression_extension(Compression compression);
+
+/* Return filename without .gz/.zst so that the format can be determined from the remaining extension */
+std::string strip_compression_extension(const std::string &filename);
+
+/* Open a file for reading; compressed files are inflated on a separate thread while the caller parses */
+std::unique_ptr<std::istream> open_input_stream(const std::string &filename);
+
+/* Open a file for writing; the output is compressed if the filename ends with .gz or .zst */
+std::unique_ptr<std::ostream> open_output_stream(const std::string &filename);
+
+/* Flush and close a stream of open_output_stream, finishing the compressed data; failures (including those of gzclose
+ * and of the final zstd frame) throw FileException. A stream destroyed without it is closed on a best-effort basis */
+void close_output_stream(std::ostream &stream, const std::string &filename);
+
+/* Write already formatted chunks in order; plain files are written with a few large writev calls */
+void write_chunks(const std::string &filename, const std::vector<std::string_view> &chunks);
+
+void write_chunks(const std::string &filename, const std::vector<std::string> &chunks);
+
+
+/* Whole contents of a file, memory-mapped if plain or decompressed into memory otherwise */
+class InputBuffer {
+    std::unique_ptr<MappedFile> mapped_{nullptr};
+    std::string data_{};
+
+public:
+    explicit InputBuffer(const std::string &filename);
+
+    [[nodiscard]] std::string_view view() const;
+};
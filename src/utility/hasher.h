@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+
+/* Two independently mixed 64-bit streams (splitmix64 finalizer) giving a 128-bit digest; not cryptographic */
+class Hasher {
+    uint64_t a_;
+    uint64_t b_;
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+public:
+    using Digest = std::array<uint64_t, 2>;
+
+    explicit Hasher(const Digest &seed = {0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL}) : a_{seed[0]}, b_{seed[1]} {}
+
+    void add(uint64_t value) {
+        a_ = mix(a_ ^ value);
+        b_ = mix(b_ + std::rotl(value, 32) + 0x9e3779b97f4a7c15ULL);
+    }
+
+    void add(double value) {
+        /* Both zeros give the same result */
+        add(std::bit_cast<uint64_t>(value == 0.0 ? 0.0 : value));
+    }
+
+    void add(const std::string &text) {
+        add(static_cast<uint64_t>(text.size()));
+        for (size_t i = 0; i < text.size(); i += sizeof(uint64_t)) {
+            uint64_t chunk = 0;
+            std::memcpy(&chunk, text.data() + i, std::min(sizeof(uint64_t), text.size() - i));
+            add(chunk);
+        }
+    }
+
+    /* Bit patterns of the values as they are stored, e.g. in a mapped file */
+    void add_raw(const char *data, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t bits;
+            std::memcpy(&bits, data + i * sizeof(uint64_t), sizeof(bits));
+            add(bits);
+        }
+    }
+
+    [[nodiscard]] Digest digest() const { return {a_, b_}; }
+};
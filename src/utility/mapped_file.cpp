@@ -0,0 +1,45 @@
+#include <string>
+#include <format>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+#include "exceptions.h"
+
+
+MappedFile::MappedFile(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw FileException(std::format("Cannot open file: {}", filename));
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw FileException(std::format("Cannot open file: {}", filename));
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+
+    /* mmap does not accept zero-length mappings, keep the view empty */
+    if (size_ != 0) {
+        void *ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            close(fd);
+            throw FileException(std::format("Cannot map file: {}", filename));
+        }
+        madvise(ptr, size_, MADV_WILLNEED);
+        data_ = static_cast<const char *>(ptr);
+    }
+
+    close(fd);
+}
+
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+}
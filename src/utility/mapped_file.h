@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+
+/* Read-only memory mapping of a whole file */
+class MappedFile {
+    const char *data_{nullptr};
+    size_t size_{0};
+
+public:
+    explicit MappedFile(const std::string &filename);
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    [[nodiscard]] std::string_view view() const { return {data_, size_}; }
+
+    [[nodiscard]] size_t size() const { return size_; }
+};
@@ -32,3 +32,29 @@ std::string trim(const std::string &text) {
 
     return std::string(first, last);
 }
+
+
+std::vector<std::string> split(const std::string &text, char delimiter) {
+    std::vector<std::string> parts;
+    for (const auto &part: text | std::views::split(delimiter)) {
+        auto token = trim(std::string(part.begin(), part.end()));
+        if (not token.empty()) {
+            parts.push_back(std::move(token));
+        }
+    }
+
+    return parts;
+}
+
+
+/* Items in the order of their first occurrence without repetitions */
+std::vector<std::string> unique(const std::vector<std::string> &items) {
+    std::vector<std::string> result;
+    for (const auto &item: items) {
+        if (std::ranges::find(result, item) == result.end()) {
+            result.push_back(item);
+        }
+    }
+
+    return result;
+}
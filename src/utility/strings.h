@@ -1,9 +1,14 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 std::string to_lowercase(const std::string &from);
 
 std::string to_uppercase(const std::string &from);
 
 std::string trim(const std::string &text);
+
+std::vector<std::string> split(const std::string &text, char delimiter);
+
+std::vector<std::string> unique(const std::vector<std::string> &items);
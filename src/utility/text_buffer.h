@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <format>
+#include <string>
+#include <string_view>
+
+
+/* Append-only text buffer formatting numbers with std::to_chars; widths pad like std::format, never truncate */
+class TextBuffer {
+    std::string data_{};
+
+    void pad(size_t length, size_t width) {
+        if (length < width) {
+            data_.append(width - length, ' ');
+        }
+    }
+
+public:
+    void reserve(size_t size) { data_.reserve(size); }
+
+    [[nodiscard]] size_t size() const { return data_.size(); }
+
+    [[nodiscard]] std::string release() { return std::move(data_); }
+
+    TextBuffer &append(char c) {
+        data_.push_back(c);
+        return *this;
+    }
+
+    TextBuffer &append(std::string_view text) {
+        data_.append(text);
+        return *this;
+    }
+
+    /* Equivalent to {:<width} */
+    TextBuffer &append_left(std::string_view text, size_t width) {
+        data_.append(text);
+        pad(text.size(), width);
+        return *this;
+    }
+
+    /* Equivalent to {:>width} */
+    TextBuffer &append_right(std::string_view text, size_t width) {
+        pad(text.size(), width);
+        data_.append(text);
+        return *this;
+    }
+
+    /* Equivalent to {:>width.precisionf} */
+    TextBuffer &append_fixed(double value, int precision, size_t width = 0) {
+        /* The largest double has 309 digits before the decimal point; larger precisions go through std::format */
+        std::array<char, 384> buffer{};
+        auto [end, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value, std::chars_format::fixed,
+                                       precision);
+        if (ec != std::errc{}) {
+            return append_right(std::format("{:.{}f}", value, precision), width);
+        }
+        return append_right({buffer.data(), static_cast<size_t>(end - buffer.data())}, width);
+    }
+
+    /* Equivalent to {:>width} for integers */
+    TextBuffer &append_int(long long value, size_t width = 0) {
+        std::array<char, 24> buffer{};
+        auto end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value).ptr;
+        return append_right({buffer.data(), static_cast<size_t>(end - buffer.data())}, width);
+    }
+};
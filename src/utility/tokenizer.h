@@ -0,0 +1,63 @@
+#pragma once
+
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+
+/* Allocation-free helpers for parsing text formats held in memory */
+
+/* Return the next line from data (without the line terminator) and advance pos behind it */
+inline bool next_line(std::string_view data, size_t &pos, std::string_view &line) {
+    if (pos >= data.size()) {
+        return false;
+    }
+
+    auto end = data.find('\n', pos);
+    if (end == std::string_view::npos) {
+        end = data.size();
+    }
+
+    line = data.substr(pos, end - pos);
+    if (not line.empty() and line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+
+    pos = end + 1;
+    return true;
+}
+
+
+/* Return the next whitespace-separated token from line and advance pos behind it */
+inline bool next_token(std::string_view line, size_t &pos, std::string_view &token) {
+    auto is_space = [](char c) noexcept { return c == ' ' or c == '\t' or c == '\r' or c == '\n'; };
+
+    while (pos < line.size() and is_space(line[pos])) {
+        pos++;
+    }
+
+    if (pos >= line.size()) {
+        return false;
+    }
+
+    size_t start = pos;
+    while (pos < line.size() and not is_space(line[pos])) {
+        pos++;
+    }
+
+    token = line.substr(start, pos - start);
+    return true;
+}
+
+
+/* Parse a number at the beginning of token; trailing characters are ignored like in std::stoi */
+template<typename T>
+inline bool parse_number(std::string_view token, T &value) {
+    const char *first = token.data();
+    const char *last = token.data() + token.size();
+    if (first != last and *first == '+') {
+        first++;
+    }
+    auto [ptr, ec] = std::from_chars(first, last, value);
+    return ec == std::errc() and ptr != first;
+}